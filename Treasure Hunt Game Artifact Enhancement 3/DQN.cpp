@@ -1,5 +1,142 @@
 #include "DQN.h"
+#include "Kernels.h"
+#include "MappedFile.h"
 #include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Smallest sub-batch worth handing to its own training thread
+const int MIN_ROWS_PER_SHARD = 8;
+
+namespace {
+
+    // Checkpoint file: header, layer sizes, then the flat params (64-byte aligned)
+    // followed by the optimizer state, both exactly as they sit in memory
+    struct CheckpointHeader {
+        char magic[4];                  // "THDQ"
+        uint32_t version;
+        uint32_t num_layer_sizes;       // input, hidden..., output
+        uint32_t optimizer;             // Optimizer enum value
+        uint64_t param_count;
+        uint64_t optimizer_state_count; // floats after the params: Adam moment1 then moment2, RMSProp moment2
+        uint64_t optimizer_step;
+        uint64_t params_offset;         // byte offset of the params
+        float lr;
+        float decay1;
+        float decay2;
+        float epsilon;
+    };
+
+    const char checkpoint_magic[4] = { 'T', 'H', 'D', 'Q' };
+    const uint32_t checkpoint_version = 2;
+    const size_t checkpoint_alignment = 64;
+
+    // Validated pointers into a mapped checkpoint
+    struct CheckpointView {
+        CheckpointHeader header;
+        const uint32_t* layer_sizes;
+        const float* params;
+        const float* optimizer_state;
+    };
+
+    // Push a written file's contents to the disk, so a rename after it cannot reach the disk first
+    bool sync_file(std::FILE* f) {
+        if (std::fflush(f) != 0) return false;
+#ifdef _WIN32
+        return _commit(_fileno(f)) == 0;
+#else
+        return fsync(fileno(f)) == 0;
+#endif
+    }
+
+    // Make a rename into path's directory durable. Windows' MOVEFILE_WRITE_THROUGH already does;
+    // filesystems that cannot sync a directory are left as they are
+    void sync_parent_directory(const std::string& path) {
+#ifndef _WIN32
+        size_t slash = path.find_last_of('/');
+        std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0) return;
+        fsync(fd);
+        close(fd);
+#else
+        (void)path;
+#endif
+    }
+
+    // Moment buffers an optimizer keeps per parameter
+    size_t moment_buffers(Optimizer opt) {
+        switch (opt) {
+        case Optimizer::Adam:    return 2;
+        case Optimizer::RMSProp: return 1;
+        default:                 return 0;
+        }
+    }
+
+    CheckpointView read_checkpoint(const MappedFile& file, const std::string& path) {
+        CheckpointView view;
+        if (file.size() < sizeof(CheckpointHeader))
+            throw std::runtime_error("Checkpoint " + path + " is truncated");
+        std::memcpy(&view.header, file.data(), sizeof(CheckpointHeader));
+
+        const CheckpointHeader& h = view.header;
+        if (std::memcmp(h.magic, checkpoint_magic, sizeof(checkpoint_magic)) != 0)
+            throw std::runtime_error(path + " is not a DQN checkpoint");
+        if (h.version != checkpoint_version)
+            throw std::runtime_error("Checkpoint " + path + " has unsupported version " + std::to_string(h.version));
+
+        // Every count is checked against the file size before it is multiplied, so a corrupt
+        // header can neither overflow the arithmetic nor size a network the file cannot hold
+        std::runtime_error corrupt("Checkpoint " + path + " is truncated or corrupt");
+        uint64_t max_floats = file.size() / sizeof(float);
+        if (h.num_layer_sizes < 2 || h.num_layer_sizes > max_floats)
+            throw corrupt;
+        size_t sizes_end = sizeof(CheckpointHeader) + sizeof(uint32_t) * (size_t)h.num_layer_sizes;
+        if (sizes_end > file.size())
+            throw corrupt;
+        view.layer_sizes = reinterpret_cast<const uint32_t*>(file.data() + sizeof(CheckpointHeader));
+
+        // The params the layer sizes imply must be exactly the ones the header announces
+        uint64_t expected = 0;
+        for (uint32_t l = 0; l < h.num_layer_sizes; ++l) {
+            uint32_t size = view.layer_sizes[l];
+            if (size == 0 || size > (uint32_t)INT_MAX)
+                throw corrupt;
+            if (l == 0) continue;
+            uint64_t layer = (uint64_t)view.layer_sizes[l - 1] * size + size; // fits: both factors < 2^31
+            if (layer > max_floats - expected)
+                throw corrupt;
+            expected += layer;
+        }
+
+        if (h.param_count != expected || h.optimizer > (uint32_t)Optimizer::Adam ||
+            h.optimizer_state_count != moment_buffers((Optimizer)h.optimizer) * h.param_count ||
+            h.params_offset < sizes_end || h.params_offset % sizeof(float) != 0 || h.params_offset > file.size() ||
+            (file.size() - h.params_offset) / sizeof(float) < h.param_count + h.optimizer_state_count)
+            throw corrupt;
+
+        view.params = reinterpret_cast<const float*>(file.data() + h.params_offset);
+        view.optimizer_state = view.params + h.param_count;
+        return view;
+    }
+
+    void open_checkpoint(MappedFile& file, const std::string& path) {
+        if (!file.open(path))
+            throw std::runtime_error("Cannot open checkpoint " + path);
+    }
+}
 
 // Constructor
 DQN::DQN(int input, const std::vector<int>& hidden, int output, float learning_rate)
@@ -7,43 +144,186 @@ DQN::DQN(int input, const std::vector<int>& hidden, int output, float learning_r
 {
     rng.seed(std::random_device{}());
 
-    int prev_size = input_size;
+    layer_sizes.push_back(input_size);
+    for (int hsize : hidden_sizes) layer_sizes.push_back(hsize);
+    layer_sizes.push_back(output_size_); // Output layer
 
-    for (int hsize : hidden_sizes) {
-        std::vector<std::vector<float>> W(prev_size, std::vector<float>(hsize));
-        for (int i = 0; i < prev_size; ++i)
-            for (int j = 0; j < hsize; ++j)
-                W[i][j] = dist(rng);
-        weights.push_back(W);
-        biases.push_back(std::vector<float>(hsize, 0.0f));
-        prev_size = hsize;
+    // Lay out weights and biases of every layer back to back
+    size_t total = 0;
+    for (size_t l = 0; l + 1 < layer_sizes.size(); ++l) {
+        weight_offset.push_back(total);
+        total += (size_t)layer_sizes[l] * layer_sizes[l + 1];
+        bias_offset.push_back(total);
+        total += layer_sizes[l + 1];
     }
+    params.assign(total, 0.0f);
 
-    // Output layer
-    std::vector<std::vector<float>> W_out(prev_size, std::vector<float>(output_size_));
-    for (int i = 0; i < prev_size; ++i)
-        for (int j = 0; j < output_size_; ++j)
-            W_out[i][j] = dist(rng);
-    weights.push_back(W_out);
-    biases.push_back(std::vector<float>(output_size_, 0.0f));
+    for (size_t l = 0; l < num_layers(); ++l) {
+        float* W = weights(l);
+        size_t count = (size_t)layer_sizes[l] * layer_sizes[l + 1];
+        for (size_t i = 0; i < count; ++i)
+            W[i] = dist(rng);
+    }
+
+    int widest = *std::max_element(layer_sizes.begin(), layer_sizes.end());
+    workspace.ping.assign(widest, 0.0f);
+    workspace.pong.assign(widest, 0.0f);
+    shards.resize(1);
+}
+
+void DQN::copy_weights_from(const DQN& other) {
+    if (other.layer_sizes != layer_sizes)
+        throw std::runtime_error("copy_weights_from: network shapes differ");
+    std::copy(other.params.begin(), other.params.end(), params.begin());
+    ++params_version;
+}
+
+void DQN::set_num_threads(int n) {
+    n = std::max(1, n);
+    if (n == num_threads()) return;
+    if (n == 1) pool.reset();
+    else pool.reset(new ThreadPool(n));
+    shards.resize(n);
+}
+
+void DQN::save_checkpoint(const std::string& path) const {
+    CheckpointHeader header = {};
+    std::memcpy(header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+    header.version = checkpoint_version;
+    header.num_layer_sizes = (uint32_t)layer_sizes.size();
+    header.optimizer = (uint32_t)optimizer;
+    header.param_count = params.size();
+    header.optimizer_state_count = moment1.size() + moment2.size();
+    header.optimizer_step = optimizer_step;
+    header.lr = lr;
+    header.decay1 = decay1;
+    header.decay2 = decay2;
+    header.epsilon = epsilon;
+
+    std::vector<uint32_t> sizes(layer_sizes.begin(), layer_sizes.end());
+    size_t sizes_end = sizeof(header) + sizeof(uint32_t) * sizes.size();
+    header.params_offset = (sizes_end + checkpoint_alignment - 1) / checkpoint_alignment * checkpoint_alignment;
+    const char padding[checkpoint_alignment] = {};
+
+    std::string tmp_path = path + ".tmp";
+    std::FILE* f = std::fopen(tmp_path.c_str(), "wb");
+    if (!f) throw std::runtime_error("Cannot write checkpoint " + tmp_path);
+    bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1 &&
+        std::fwrite(sizes.data(), sizeof(uint32_t), sizes.size(), f) == sizes.size() &&
+        std::fwrite(padding, 1, header.params_offset - sizes_end, f) == header.params_offset - sizes_end &&
+        std::fwrite(params.data(), sizeof(float), params.size(), f) == params.size() &&
+        (moment1.empty() || std::fwrite(moment1.data(), sizeof(float), moment1.size(), f) == moment1.size()) &&
+        (moment2.empty() || std::fwrite(moment2.data(), sizeof(float), moment2.size(), f) == moment2.size()) &&
+        sync_file(f);
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) {
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error("Writing checkpoint " + tmp_path + " failed");
+    }
+
+    // Replace the old checkpoint in one step, so path always holds a complete checkpoint,
+    // even after a power loss: the data was synced above and the rename is synced below
+#ifdef _WIN32
+    bool moved = MoveFileExA(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    bool moved = std::rename(tmp_path.c_str(), path.c_str()) == 0;
+#endif
+    if (!moved)
+        throw std::runtime_error("Cannot move checkpoint into place at " + path);
+    sync_parent_directory(path);
+}
+
+void DQN::load_checkpoint(const std::string& path) {
+    MappedFile file;
+    open_checkpoint(file, path);
+    CheckpointView view = read_checkpoint(file, path);
+
+    if (!std::equal(layer_sizes.begin(), layer_sizes.end(), view.layer_sizes, view.layer_sizes + view.header.num_layer_sizes) ||
+        view.header.param_count != params.size())
+        throw std::runtime_error("Checkpoint " + path + " does not match this network's shape");
+    std::memcpy(params.data(), view.params, sizeof(float) * params.size());
+    ++params_version;
+
+    // Moments from a different optimizer are meaningless here; ours start over instead
+    if (view.header.optimizer != (uint32_t)optimizer) {
+        set_optimizer(optimizer, decay1, decay2, epsilon);
+        return;
+    }
+    const float* state = view.optimizer_state;
+    if (!moment1.empty()) {
+        std::memcpy(moment1.data(), state, sizeof(float) * moment1.size());
+        state += moment1.size();
+    }
+    if (!moment2.empty())
+        std::memcpy(moment2.data(), state, sizeof(float) * moment2.size());
+    optimizer_step = view.header.optimizer_step;
+}
+
+DQN DQN::from_checkpoint(const std::string& path) {
+    MappedFile file;
+    open_checkpoint(file, path);
+    CheckpointView view = read_checkpoint(file, path);
+
+    const uint32_t* sizes = view.layer_sizes;
+    uint32_t n = view.header.num_layer_sizes;
+    DQN dqn((int)sizes[0], std::vector<int>(sizes + 1, sizes + n - 1), (int)sizes[n - 1], view.header.lr);
+    std::memcpy(dqn.params.data(), view.params, sizeof(float) * dqn.params.size());
+
+    // Params and optimizer state sit back to back in the file, as in the moment buffers
+    const CheckpointHeader& h = view.header;
+    dqn.set_optimizer((Optimizer)h.optimizer, h.decay1, h.decay2, h.epsilon);
+    const float* state = view.optimizer_state;
+    if (!dqn.moment1.empty()) {
+        std::memcpy(dqn.moment1.data(), state, sizeof(float) * dqn.moment1.size());
+        state += dqn.moment1.size();
+    }
+    if (!dqn.moment2.empty())
+        std::memcpy(dqn.moment2.data(), state, sizeof(float) * dqn.moment2.size());
+    dqn.optimizer_step = h.optimizer_step;
+    return dqn;
 }
 
 // Forward pass
 std::vector<float> DQN::predict(const std::vector<float>& state) {
-    std::vector<float> activations = state;
-
-    for (size_t l = 0; l < weights.size(); ++l) {
-        std::vector<float> next(weights[l][0].size(), 0.0f);
-        for (size_t j = 0; j < next.size(); ++j) {
-            for (size_t i = 0; i < activations.size(); ++i)
-                next[j] += activations[i] * weights[l][i][j];
-            next[j] += biases[l][j];
-            if (l < weights.size() - 1) next[j] = relu(next[j]); // hidden layers
-        }
+    std::vector<float> q_values(output_size_);
+    predict_into(state.data(), q_values.data());
+    return q_values; // final Q-values
+}
+
+void DQN::predict_into(const float* state, float* out) {
+    const float* activations = state;
+    float* next = workspace.ping.data();
+    float* spare = workspace.pong.data();
+
+    for (size_t l = 0; l < num_layers(); ++l) {
+        int in = layer_sizes[l];
+        int out_size = layer_sizes[l + 1];
+        bool last = l == num_layers() - 1;
+        if (last) next = out; // output layer writes straight to the caller
+
+        std::fill(next, next + out_size, 0.0f);
+        kernels::gemv(out_size, in, activations, weights(l), next);
+        if (!last) // hidden layers
+            kernels::add_bias_relu(1, out_size, biases(l), next);
+        else
+            kernels::add_bias(1, out_size, biases(l), next);
+
         activations = next;
+        std::swap(next, spare);
     }
+}
+
+// Batched forward pass
+std::vector<float> DQN::predict_batch(const float* states, int n) {
+    if (n <= 0) return {};
+    forward_batch(states, n, shards[0]);
+    return shards[0].activations.back();
+}
 
-    return activations; // final Q-values
+void DQN::predict_batch_into(const float* states, int n, float* out) {
+    if (n <= 0) return;
+    forward_batch(states, n, shards[0]);
+    std::copy(shards[0].activations.back().begin(), shards[0].activations.back().end(), out);
 }
 
 // Training
@@ -51,51 +331,174 @@ void DQN::fit(const std::vector<std::vector<float>>& inputs,
     const std::vector<std::vector<float>>& targets,
     int epochs)
 {
+    int batch = (int)inputs.size();
+    if (batch == 0) return;
+
+    std::vector<float> flat_inputs, flat_targets;
+    flat_inputs.reserve((size_t)batch * input_size);
+    flat_targets.reserve((size_t)batch * output_size_);
+    for (int k = 0; k < batch; ++k) {
+        flat_inputs.insert(flat_inputs.end(), inputs[k].begin(), inputs[k].end());
+        flat_targets.insert(flat_targets.end(), targets[k].begin(), targets[k].end());
+    }
+
+    fit(flat_inputs.data(), flat_targets.data(), batch, epochs);
+}
+
+void DQN::fit(const float* inputs, const float* targets, int batch, int epochs,
+    const float* sample_weights)
+{
+    if (batch <= 0) return;
+
+    // Keep each shard big enough that the matrix products stay worthwhile
+    int n_shards = std::min(num_threads(), std::max(1, batch / MIN_ROWS_PER_SHARD));
+
     for (int e = 0; e < epochs; ++e) {
-        for (size_t k = 0; k < inputs.size(); ++k) {
-            std::vector<std::vector<float>> activations;
-            activations.push_back(inputs[k]);
-
-            // Forward pass
-            for (size_t l = 0; l < weights.size(); ++l) {
-                std::vector<float> next(weights[l][0].size(), 0.0f);
-                for (size_t j = 0; j < next.size(); ++j) {
-                    for (size_t i = 0; i < activations[l].size(); ++i)
-                        next[j] += activations[l][i] * weights[l][i][j];
-                    next[j] += biases[l][j];
-                    if (l < weights.size() - 1) next[j] = relu(next[j]);
-                }
-                activations.push_back(next);
-            }
-
-            // Output error
-            std::vector<float> error(weights.back()[0].size(), 0.0f);
-            for (size_t i = 0; i < error.size(); ++i)
-                error[i] = targets[k][i] - activations.back()[i];
-
-            std::vector<float> delta = error;
-
-            // Backpropagation
-            for (int l = (int)weights.size() - 1; l >= 0; --l) {
-                std::vector<float> prev_activations = activations[l];
-                std::vector<float> delta_next(weights[l].size(), 0.0f);
-
-                for (size_t i = 0; i < weights[l].size(); ++i) {
-                    for (size_t j = 0; j < weights[l][i].size(); ++j) {
-                        weights[l][i][j] += lr * delta[j] * prev_activations[i];
-                        delta_next[i] += delta[j] * weights[l][i][j];
-                    }
-                }
-
-                for (size_t j = 0; j < biases[l].size(); ++j)
-                    biases[l][j] += lr * delta[j];
-
-                if (l > 0) {
-                    for (size_t i = 0; i < delta_next.size(); ++i)
-                        delta_next[i] *= relu_derivative(prev_activations[i]);
-                    delta = delta_next;
-                }
-            }
+        if (n_shards == 1) {
+            forward_batch(inputs, batch, shards[0]);
+            backward_batch(targets, sample_weights, batch, shards[0]);
+        }
+        else {
+            // Each thread computes gradients of its rows into its own workspace
+            pool->run(n_shards, [&](int s) {
+                int lo = (int)((long long)batch * s / n_shards);
+                int hi = (int)((long long)batch * (s + 1) / n_shards);
+                forward_batch(inputs + (size_t)lo * input_size, hi - lo, shards[s]);
+                backward_batch(targets + (size_t)lo * output_size_,
+                    sample_weights ? sample_weights + lo : nullptr, hi - lo, shards[s]);
+            });
+            for (int s = 1; s < n_shards; ++s)
+                kernels::axpy((int)params.size(), 1.0f, shards[s].grads.data(), shards[0].grads.data());
+        }
+
+        apply_update(shards[0].grads.data(), batch);
+    }
+}
+
+void DQN::set_optimizer(Optimizer opt, float d1, float d2, float eps) {
+    optimizer = opt;
+    decay1 = d1;
+    decay2 = d2;
+    epsilon = eps;
+    optimizer_step = 0;
+    moment1.assign(opt == Optimizer::Adam ? params.size() : 0, 0.0f);
+    moment2.assign(opt != Optimizer::SGD ? params.size() : 0, 0.0f);
+}
+
+// One update per batch; every rule is a single fused pass over params.
+// Adam and RMSProp use the mean gradient, SGD the summed one so that lr keeps
+// the step size of the old per-sample updates
+void DQN::apply_update(const float* grads, int batch) {
+    int n = (int)params.size();
+    ++params_version;
+    float scale = 1.0f / batch;
+    switch (optimizer) {
+    case Optimizer::Adam: {
+        ++optimizer_step;
+        double t = (double)optimizer_step;
+        float step_size = (float)(lr * std::sqrt(1.0 - std::pow((double)decay2, t)) / (1.0 - std::pow((double)decay1, t)));
+        kernels::adam_update(n, step_size, decay1, decay2, epsilon, scale, grads,
+            moment1.data(), moment2.data(), params.data());
+        break;
+    }
+    case Optimizer::RMSProp:
+        ++optimizer_step;
+        kernels::rmsprop_update(n, lr, decay1, epsilon, scale, grads, moment2.data(), params.data());
+        break;
+    default:
+        kernels::axpy(n, lr, grads, params.data());
+        break;
+    }
+}
+
+void DQN::predict_sparse_batch(const uint64_t* free_bits, const int* marked_cells, float mark_value, int n, float* out) {
+    if (n <= 0) return;
+    int hidden = layer_sizes[1];
+    size_t words = ((size_t)input_size + 63) / 64;
+
+    // Refresh the free-cell sum when the layout or the weights changed
+    if (sparse_version != params_version || sparse_bits.size() != words ||
+        !std::equal(sparse_bits.begin(), sparse_bits.end(), free_bits))
+    {
+        sparse_bits.assign(free_bits, free_bits + words);
+        sparse_base.assign(hidden, 0.0f);
+        kernels::add_rows_masked(input_size, hidden, free_bits, weights(0), sparse_base.data());
+        sparse_version = params_version;
+    }
+
+    TrainWorkspace& ws = shards[0];
+    ws.activations.resize(layer_sizes.size());
+    std::vector<float>& first = ws.activations[1];
+    first.resize((size_t)n * hidden);
+    for (int k = 0; k < n; ++k) {
+        int cell = marked_cells[k];
+        bool free_cell = (free_bits[cell >> 6] >> (cell & 63)) & 1;
+        float* row = first.data() + (size_t)k * hidden;
+        std::copy(sparse_base.begin(), sparse_base.end(), row);
+        kernels::axpy(hidden, mark_value - (free_cell ? 1.0f : 0.0f), weights(0) + (size_t)cell * hidden, row);
+    }
+    if (num_layers() > 1)
+        kernels::add_bias_relu(n, hidden, biases(0), first.data());
+    else
+        kernels::add_bias(n, hidden, biases(0), first.data());
+
+    forward_layers(1, n, ws);
+    std::copy(ws.activations.back().begin(), ws.activations.back().end(), out);
+}
+
+// Forward pass of the whole batch, one matrix product per layer
+void DQN::forward_batch(const float* inputs, int batch, TrainWorkspace& ws) {
+    ws.activations.resize(layer_sizes.size());
+    ws.activations[0].assign(inputs, inputs + (size_t)batch * input_size);
+    forward_layers(0, batch, ws);
+}
+
+// Layers from activations[first] onwards
+void DQN::forward_layers(size_t first, int batch, TrainWorkspace& ws) {
+    for (size_t l = first; l < num_layers(); ++l) {
+        int in = layer_sizes[l];
+        int out = layer_sizes[l + 1];
+        std::vector<float>& next = ws.activations[l + 1];
+        next.assign((size_t)batch * out, 0.0f);
+
+        kernels::gemm_nn(batch, out, in, ws.activations[l].data(), weights(l), next.data());
+        if (l < num_layers() - 1)
+            kernels::add_bias_relu(batch, out, biases(l), next.data());
+        else
+            kernels::add_bias(batch, out, biases(l), next.data());
+    }
+}
+
+// Backpropagation of the whole batch; accumulates the summed update direction into ws.grads
+void DQN::backward_batch(const float* targets, const float* sample_weights, int batch, TrainWorkspace& ws) {
+    ws.grads.assign(params.size(), 0.0f);
+
+    // Output error
+    const std::vector<float>& output = ws.activations.back();
+    ws.delta.resize(output.size());
+    for (size_t i = 0; i < output.size(); ++i)
+        ws.delta[i] = targets[i] - output[i];
+    if (sample_weights)
+        for (int k = 0; k < batch; ++k)
+            for (int j = 0; j < output_size_; ++j)
+                ws.delta[(size_t)k * output_size_ + j] *= sample_weights[k];
+
+    for (int l = (int)num_layers() - 1; l >= 0; --l) {
+        int in = layer_sizes[l];
+        int out = layer_sizes[l + 1];
+        const std::vector<float>& prev_activations = ws.activations[l];
+
+        // dW = prev^T * delta, db = sum of delta rows
+        kernels::gemm_tn(batch, out, in, prev_activations.data(), ws.delta.data(),
+            ws.grads.data() + weight_offset[l]);
+        for (int k = 0; k < batch; ++k)
+            kernels::add_bias(1, out, ws.delta.data() + (size_t)k * out, ws.grads.data() + bias_offset[l]);
+
+        if (l > 0) {
+            ws.delta_prev.assign((size_t)batch * in, 0.0f);
+            kernels::gemm_nt(batch, out, in, ws.delta.data(), weights(l), ws.delta_prev.data());
+            kernels::relu_backward((int)ws.delta_prev.size(), prev_activations.data(), ws.delta_prev.data());
+            ws.delta.swap(ws.delta_prev);
         }
     }
 }
@@ -2,6 +2,27 @@
 #include <vector>
 #include <random>
 #include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "ThreadPool.h"
+
+// Ping-pong activation buffers for single-state inference, sized once to the widest layer
+struct InferenceWorkspace {
+    std::vector<float> ping;
+    std::vector<float> pong;
+};
+
+// Buffers for one forward/backward pass over a (sub-)batch; one per training thread
+struct TrainWorkspace {
+    std::vector<std::vector<float>> activations; // [layer][batch x size]
+    std::vector<float> delta;
+    std::vector<float> delta_prev;
+    std::vector<float> grads;                    // same layout as params
+};
+
+// Rule fit uses to turn the batch gradient into a parameter update
+enum class Optimizer { SGD, RMSProp, Adam };
 
 class DQN {
 private:
@@ -10,14 +31,51 @@ private:
     int output_size_;
     float lr;
 
-    std::vector<std::vector<std::vector<float>>> weights; // weights[layer][from][to]
-    std::vector<std::vector<float>> biases;               // biases[layer][to]
+    // All layers live in one contiguous buffer:
+    // layer l weights are row-major [from][to] at params[weight_offset[l]],
+    // followed by its biases[to] at params[bias_offset[l]]
+    std::vector<int> layer_sizes; // input, hidden..., output
+    std::vector<float> params;
+    std::vector<size_t> weight_offset;
+    std::vector<size_t> bias_offset;
+
+    // Optimizer state in the same flat layout as params:
+    // Adam keeps both moments, RMSProp only the squared-gradient average in moment2
+    Optimizer optimizer = Optimizer::SGD;
+    float decay1 = 0.9f;
+    float decay2 = 0.999f;
+    float epsilon = 1e-8f;
+    uint64_t optimizer_step = 0;
+    std::vector<float> moment1;
+    std::vector<float> moment2;
+
+    // Apply the summed gradient of a batch to params in one fused pass
+    void apply_update(const float* grads, int batch);
+
+    // Bumped whenever params change, so caches derived from the weights know when to refresh
+    uint64_t params_version = 1;
+
+    // Sum of the first-layer weight rows of every free cell in sparse_bits, valid at sparse_version
+    std::vector<uint64_t> sparse_bits;
+    std::vector<float> sparse_base;
+    uint64_t sparse_version = 0;
+
+    InferenceWorkspace workspace;
+
+    // Mini-batch training buffers, reused between fit calls; shards[0] is used when single threaded
+    std::vector<TrainWorkspace> shards;
+    std::unique_ptr<ThreadPool> pool;
 
     std::default_random_engine rng;
     std::uniform_real_distribution<float> dist;
 
-    float relu(float x) { return x > 0 ? x : 0; }
-    float relu_derivative(float x) { return x > 0 ? 1 : 0; }
+    size_t num_layers() const { return weight_offset.size(); }
+    float* weights(size_t l) { return params.data() + weight_offset[l]; }
+    float* biases(size_t l) { return params.data() + bias_offset[l]; }
+
+    void forward_batch(const float* inputs, int batch, TrainWorkspace& ws);
+    void forward_layers(size_t first, int batch, TrainWorkspace& ws);
+    void backward_batch(const float* targets, const float* sample_weights, int batch, TrainWorkspace& ws);
 
 public:
     // Constructor
@@ -26,10 +84,58 @@ public:
     // Predict Q-values
     std::vector<float> predict(const std::vector<float>& state);
 
+    // Predict Q-values of one state into out[output]; does not allocate
+    void predict_into(const float* state, float* out);
+
+    // Predict Q-values for n states stored back to back; returns [n x output] matrix
+    std::vector<float> predict_batch(const float* states, int n);
+
+    // Same as predict_batch, written to out[n x output]; reuses the training workspace, so it
+    // does not allocate once warmed up
+    void predict_batch_into(const float* states, int n, float* out);
+
+    // Predict Q-values of n maze observations that share one wall layout, without materialising them.
+    // Observation k is 1 on every cell whose bit is set in free_bits[(input + 63) / 64], 0 elsewhere,
+    // except marked_cells[k], which holds mark_value. The first layer is then the cached sum of the
+    // free cells' weight rows plus one scaled row per observation: O(hidden) instead of O(input x hidden).
+    // The sum is rebuilt on the first call after the weights change, at the cost of one dense observation,
+    // so in a predict / fit loop like the trainer's only the other n - 1 observations are saved.
+    // Writes out[n x output]
+    void predict_sparse_batch(const uint64_t* free_bits, const int* marked_cells, float mark_value, int n, float* out);
+
     // Train on batch of inputs and targets
     void fit(const std::vector<std::vector<float>>& inputs,
         const std::vector<std::vector<float>>& targets,
         int epochs = 1);
 
+    // Train on a flat batch: inputs [batch x input], targets [batch x output].
+    // sample_weights[batch] optionally scales each sample's error (importance sampling)
+    void fit(const float* inputs, const float* targets, int batch, int epochs = 1,
+        const float* sample_weights = nullptr);
+
+    // Switch the update rule and reset its state. Adam uses decay1/decay2 as beta1/beta2;
+    // RMSProp decays its squared-gradient average with decay1
+    void set_optimizer(Optimizer opt, float decay1 = 0.9f, float decay2 = 0.999f, float epsilon = 1e-8f);
+    Optimizer get_optimizer() const { return optimizer; }
+
+    // Overwrite this network's weights with another network of the same shape
+    void copy_weights_from(const DQN& other);
+
+    // Shard each training batch across this many threads (1 = train on the calling thread only)
+    void set_num_threads(int n);
+    int num_threads() const { return pool ? pool->size() : 1; }
+
     int output_size() const { return output_size_; }
+
+    // Write a versioned binary checkpoint: layer sizes, flat weights and biases, optimizer state.
+    // The file is written next to path, synced to disk and renamed over it, so neither a crash nor a
+    // power loss leaves a torn checkpoint
+    void save_checkpoint(const std::string& path) const;
+
+    // Restore weights from a checkpoint of a network with the same layer sizes.
+    // The optimizer state is restored too when the checkpoint was trained with the current optimizer
+    void load_checkpoint(const std::string& path);
+
+    // Build a network (and its optimizer) from a checkpoint; the file is mapped and its parameters copied in one memcpy
+    static DQN from_checkpoint(const std::string& path);
 };
@@ -3,6 +3,7 @@
 #include <random>
 #include <ctime>
 #include <iostream>
+#include <cmath>
 
 // Constructor
 GameExperience::GameExperience(int input_size,
@@ -10,71 +11,194 @@ GameExperience::GameExperience(int input_size,
     int max_memory,
     float discount,
     const std::vector<int>& hidden_layers,
-    float lr)
+    float lr,
+    int num_threads)
     : model(input_size, hidden_layers, num_actions, lr),
     max_memory(max_memory),
     discount(discount),
-    num_actions(num_actions)
+    num_actions(num_actions),
+    memory(max_memory, input_size),
+    target_model(input_size, hidden_layers, num_actions, lr),
+    next_q_cache(max_memory, 0.0f),
+    next_q_generation(max_memory, 0),
+    priorities(max_memory)
 {
+    rng.seed(std::random_device{}());
+    sample_order.reserve(max_memory);
+    model.set_num_threads(num_threads);
+    target_model.copy_weights_from(model);
     std::srand(static_cast<unsigned int>(std::time(nullptr)));
 }
 
+// Transitions added since the last periodic save would otherwise be lost at shutdown
+GameExperience::~GameExperience() {
+    try {
+        save_memory_to_db();
+        if (store) store->flush();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Final replay memory save failed: " << e.what() << std::endl;
+    }
+}
+
 // Store an episode in memory
 void GameExperience::remember(const Episode& episode) {
-    if (memory.size() >= max_memory) {
-        memory[index] = episode;       // Overwrite oldest experience
-        index = (index + 1) % max_memory;
+    // Save before the ring overwrites a transition that was never persisted
+    if (memory.inserted() - saved_watermark >= (uint64_t)max_memory)
+        save_memory_to_db();
+
+    // Overwrites the oldest experience once the buffer is full
+    int slot = memory.push(episode.envstate, episode.action, episode.reward,
+        episode.envstate_next, episode.game_over);
+    next_q_generation[slot] = 0; // any cached max Q(s') belonged to the old episode
+    if ((int)sample_order.size() < memory.size())
+        sample_order.push_back(slot);
+
+    // New experience gets the highest priority seen so it is replayed at least once
+    priorities.update(slot, std::pow(max_priority, priority_alpha));
+}
+
+void GameExperience::set_prioritized(bool enabled, float alpha, float beta) {
+    prioritized = enabled;
+    priority_alpha = alpha;
+    priority_beta = beta;
+    for (int slot = 0; slot < memory.size(); ++slot)
+        priorities.update(slot, std::pow(max_priority, priority_alpha));
+}
+
+const float* GameExperience::sample_weights() const {
+    return prioritized && !is_weights.empty() ? is_weights.data() : nullptr;
+}
+
+// Stratified proportional sampling: one slot from each equal slice of the total priority
+void GameExperience::sample_prioritized(int data_size) {
+    int mem_size = memory.size();
+    sampled_slots.resize(data_size);
+    is_weights.resize(data_size);
+
+    float total = priorities.total();
+    float segment = total / data_size;
+    float max_weight = 0.0f;
+    for (int i = 0; i < data_size; ++i) {
+        float prefix = std::uniform_real_distribution<float>(segment * i, segment * (i + 1))(rng);
+        int slot = std::min(priorities.find(prefix), mem_size - 1);
+        sampled_slots[i] = slot;
+
+        // w = (N * P(slot))^-beta, normalised by the largest weight in the batch
+        float p = std::max(priorities.priority(slot) / total, 1e-12f);
+        is_weights[i] = std::pow(mem_size * p, -priority_beta);
+        max_weight = std::max(max_weight, is_weights[i]);
+    }
+    for (float& w : is_weights) w /= max_weight;
+}
+
+void GameExperience::set_sample_with_replacement(bool with_replacement) {
+    sample_with_replacement = with_replacement;
+}
+
+// Pick data_size memory slots into sampled_slots
+void GameExperience::sample_slots(int data_size) {
+    int mem_size = memory.size();
+    sampled_slots.resize(data_size);
+
+    if (sample_with_replacement) {
+        std::uniform_int_distribution<int> pick(0, mem_size - 1);
+        for (int i = 0; i < data_size; ++i)
+            sampled_slots[i] = pick(rng);
+        return;
     }
-    else {
-        memory.push_back(episode);
+
+    // Partial Fisher-Yates: the first data_size entries become a uniform sample
+    for (int i = 0; i < data_size; ++i) {
+        int j = std::uniform_int_distribution<int>(i, mem_size - 1)(rng);
+        std::swap(sample_order[i], sample_order[j]);
+        sampled_slots[i] = sample_order[i];
     }
 }
 
+// Refresh the target network and drop every cached max Q(s')
+void GameExperience::sync_target() {
+    target_model.copy_weights_from(model);
+    ++target_generation;
+    steps_since_sync = 0;
+}
+
+void GameExperience::set_target_sync_interval(int n) {
+    target_sync_every = std::max(1, n);
+}
+
 // Predict Q-values for a given envstate
 std::vector<float> GameExperience::predict(const std::vector<float>& envstate) {
     return model.predict(envstate);
 }
 
 // Generate training data from memory
-void GameExperience::get_data(std::vector<std::vector<float>>& inputs,
-    std::vector<std::vector<float>>& targets,
+int GameExperience::get_data(std::vector<float>& inputs,
+    std::vector<float>& targets,
     int data_size)
 {
-    if (memory.empty()) return;
+    if (memory.empty()) return 0;
 
-    int mem_size = static_cast<int>(memory.size());
+    int mem_size = memory.size();
     data_size = std::min(mem_size, data_size);
+    int state_size = memory.state_size();
 
     inputs.clear();
-    targets.clear();
-    inputs.reserve(data_size);
-    targets.reserve(data_size);
+    next_states.clear();
+    inputs.reserve((size_t)data_size * state_size);
+    next_states.reserve((size_t)data_size * state_size);
 
-    // Randomly shuffle memory indices
-    std::vector<int> indices(mem_size);
-    for (int i = 0; i < mem_size; ++i) indices[i] = i;
-    std::shuffle(indices.begin(), indices.end(), std::mt19937{ std::random_device{}() });
+    // Randomly pick memory slots
+    if (prioritized) sample_prioritized(data_size);
+    else sample_slots(data_size);
 
-    for (int i = 0; i < data_size; ++i) {
-        const Episode& e = memory[indices[i]];
+    if (++steps_since_sync >= target_sync_every) sync_target();
 
-        inputs.push_back(e.envstate);
-        std::vector<float> target = model.predict(e.envstate);
+    stale_slots.clear();
+    for (int slot : sampled_slots) {
+        const float* state = memory.state(slot);
+        inputs.insert(inputs.end(), state, state + state_size);
+        if (!memory.game_over(slot) && next_q_generation[slot] != target_generation) {
+            next_q_generation[slot] = target_generation; // also dedups repeated slots
+            stale_slots.push_back(slot);
+            const float* next = memory.next_state(slot);
+            next_states.insert(next_states.end(), next, next + state_size);
+        }
+    }
 
-        // Compute Q-value for next state
-        float Q_sa = 0.0f;
-        if (!e.game_over) {
-            auto next_q = model.predict(e.envstate_next);
-            Q_sa = *std::max_element(next_q.begin(), next_q.end());
+    // Current Q-values in one batched pass; max Q(s') only for slots not cached since the last sync
+    targets.resize((size_t)data_size * num_actions);
+    model.predict_batch_into(inputs.data(), data_size, targets.data());
+    if (!stale_slots.empty()) {
+        int n_stale = static_cast<int>(stale_slots.size());
+        next_q.resize((size_t)n_stale * num_actions);
+        target_model.predict_batch_into(next_states.data(), n_stale, next_q.data());
+        for (int i = 0; i < n_stale; ++i) {
+            const float* q = next_q.data() + (size_t)i * num_actions;
+            next_q_cache[stale_slots[i]] = *std::max_element(q, q + num_actions);
         }
+    }
+
+    for (int i = 0; i < data_size; ++i) {
+        int slot = sampled_slots[i];
+        float Q_sa = memory.game_over(slot) ? 0.0f : next_q_cache[slot];
+        float& target = targets[(size_t)i * num_actions + memory.action(slot)];
+        float td_target = memory.reward(slot) + discount * Q_sa;
 
-        target[e.action] = e.reward + (e.game_over ? 0.0f : discount * Q_sa);
+        // New priority from the TD error against the current estimate
+        if (prioritized) {
+            float error = std::fabs(td_target - target) + 1e-3f;
+            max_priority = std::max(max_priority, error);
+            priorities.update(slot, std::pow(error, priority_alpha));
+        }
 
-        targets.push_back(target);
+        target = td_target;
     }
+
+    return data_size;
 }
 
-// ----------------- MongoDB Saving Functionality -----------------
+// ----------------- Replay Memory Persistence -----------------
 
 // Call this when an epoch is completed
 void GameExperience::epoch_complete() {
@@ -84,35 +208,50 @@ void GameExperience::epoch_complete() {
     }
 }
 
-// Save the memory buffer to MongoDB
+// Hand transitions added since the last save to the store
 void GameExperience::save_memory_to_db() {
-    if (memory.empty()) return;
+    if (!store || memory.inserted() == saved_watermark) return;
 
-    auto collection = mongo_client[db_name][collection_name];
+    TransitionBatch batch;
+    memory.copy_since(saved_watermark, batch);
+    batch.first_seq += seq_base;
+    store->save(std::move(batch));
 
-    for (const auto& e : memory) {
-        bsoncxx::builder::stream::document doc{};
-        auto arr_state = bsoncxx::builder::stream::array{};
-        for (float val : e.envstate)
-            arr_state << val;
+    // Only now: a save that throws leaves its transitions for the next attempt
+    saved_watermark = memory.inserted();
+}
+
+// Optional: set how often to save
+void GameExperience::set_save_interval(int n) {
+    save_every_n_epochs = n;
+}
 
-        auto arr_next = bsoncxx::builder::stream::array{};
-        for (float val : e.envstate_next)
-            arr_next << val;
+// Pending saves go to the previous store before it is replaced. Unsaved transitions are
+// numbered after the newest one already stored, so runs never reuse sequence numbers
+void GameExperience::set_replay_store(std::unique_ptr<ReplayStore> replay_store) {
+    if (store) store->flush();
+    store = std::move(replay_store);
+    if (store) seq_base = store->next_seq() - saved_watermark;
+}
 
-        doc << "envstate" << arr_state
-            << "envstate_next" << arr_next
-            << "action" << e.action
-            << "reward" << e.reward
-            << "game_over" << e.game_over;
+int GameExperience::load_memory_from_db() {
+    if (!store) return 0;
 
-        collection.insert_one(doc.view());
-    }
+    uint64_t next_seq = 0;
+    store->load(memory, num_actions, next_seq);
 
-    std::cout << "Saved " << memory.size() << " episodes to MongoDB." << std::endl;
+    // Everything loaded is already stored; new transitions continue after the newest one
+    saved_watermark = memory.inserted();
+    seq_base = next_seq - memory.inserted();
+    reset_replay_state();
+    return memory.size();
 }
 
-// Optional: set how often to save
-void GameExperience::set_save_interval(int n) {
-    save_every_n_epochs = n;
+void GameExperience::reset_replay_state() {
+    sample_order.clear();
+    for (int slot = 0; slot < memory.size(); ++slot) {
+        sample_order.push_back(slot);
+        next_q_generation[slot] = 0;
+        priorities.update(slot, std::pow(max_priority, priority_alpha));
+    }
 }
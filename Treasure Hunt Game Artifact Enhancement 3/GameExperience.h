@@ -5,33 +5,35 @@
 #include <algorithm>
 #include <random>
 #include "DQN.h"
+#include "ReplayBuffer.h"
+#include "SumTree.h"
 
-// MongoDB
-#include <mongocxx/client.hpp>
-#include <mongocxx/instance.hpp>
-#include <mongocxx/uri.hpp>
-#include <bsoncxx/json.hpp>
-#include <bsoncxx/builder/stream/document.hpp>
-#include <bsoncxx/builder/stream/array.hpp>
+// Persistence
+#include <memory>
+#include "ReplayStore.h"
 
-// Episode structure
+// Episode structure; the states point at caller-owned observations of input_size floats
 struct Episode {
-    std::vector<float> envstate;
+    const float* envstate;
     int action;
     float reward;
-    std::vector<float> envstate_next;
+    const float* envstate_next;
     bool game_over;
 };
 
 class GameExperience {
 public:
     GameExperience(int input_size, int num_actions = 4, int max_memory = 100, float discount = 0.95f,
-        const std::vector<int>& hidden_layers = { 64,64,64,64,64 }, float lr = 0.001f);
+        const std::vector<int>& hidden_layers = { 64,64,64,64,64 }, float lr = 0.001f,
+        int num_threads = 1);
+    // Saves whatever the periodic saves have not reached yet and waits for the store
+    ~GameExperience();
 
     void remember(const Episode& episode);
     std::vector<float> predict(const std::vector<float>& envstate);
-    void get_data(std::vector<std::vector<float>>& inputs,
-        std::vector<std::vector<float>>& targets,
+    // Fills inputs [n x input] and targets [n x actions]; returns n
+    int get_data(std::vector<float>& inputs,
+        std::vector<float>& targets,
         int data_size = 10);
 
     DQN model; // the DQN neural network
@@ -41,20 +43,75 @@ public:
     void save_memory_to_db();
     void set_save_interval(int n);
 
-    
+    // Where saves go (MongoDB, a local mapped file, ...); without a store saving is disabled
+    void set_replay_store(std::unique_ptr<ReplayStore> replay_store);
+
+    // Replace memory with the newest max_memory transitions in the store; returns how many were loaded
+    int load_memory_from_db();
+
+    // Draw training samples with or without replacement (default: without)
+    void set_sample_with_replacement(bool with_replacement);
+
+    // Sample proportionally to TD error instead of uniformly.
+    // alpha shapes the priorities, beta the importance-sampling correction
+    void set_prioritized(bool enabled, float alpha = 0.6f, float beta = 0.4f);
+
+    // Importance-sampling weights of the last get_data batch, or nullptr when sampling uniformly
+    const float* sample_weights() const;
+
+    // Copy the online network into the target network every n training steps
+    void set_target_sync_interval(int n);
+
+    // Copy the online network into the target network now, e.g. after model was restored from a checkpoint
+    void sync_target();
 
 private:
     int max_memory;
     float discount;
     int num_actions;
-    std::vector<Episode> memory;
-    int index = 0;
-    std::default_random_engine rng;
-
-    mongocxx::instance mongo_instance{};
-    mongocxx::client mongo_client{ mongocxx::uri{"mongodb://localhost:27017"} };
-    std::string db_name = "game_db";
-    std::string collection_name = "experience_buffer";
+    ReplayBuffer memory;
+    std::vector<float> next_states; // scratch batch for get_data
+    std::vector<float> next_q;      // scratch target-network output for get_data
+
+    // Frozen copy of model used for the bootstrap max Q(s') term
+    DQN target_model;
+    int target_sync_every = 100;
+    int steps_since_sync = 0;
+    unsigned target_generation = 1;
+
+    // max Q(s') per memory slot, valid while its generation matches target_generation
+    std::vector<float> next_q_cache;
+    std::vector<unsigned> next_q_generation;
+    std::vector<int> stale_slots;     // scratch for get_data
+    std::vector<int> sampled_slots;   // scratch for get_data
+
+    std::mt19937 rng;
+
+    // Sampling without replacement keeps a permutation of the slots and
+    // partially shuffles its front, so each draw costs O(data_size)
+    bool sample_with_replacement = false;
+    std::vector<int> sample_order;
+    void sample_slots(int data_size);
+
+    // Prioritized replay: priorities are stored already raised to alpha
+    bool prioritized = false;
+    float priority_alpha = 0.6f;
+    float priority_beta = 0.4f;
+    float max_priority = 1.0f;
+    SumTree priorities;
+    std::vector<float> is_weights;
+    void sample_prioritized(int data_size);
+
+    // Rebuild sampling, priority and cache state after memory was refilled
+    void reset_replay_state();
+
+    std::unique_ptr<ReplayStore> store;
     int epoch_counter = 0;
     int save_every_n_epochs = 10;
+
+    // Sequence number of the first transition not yet persisted; saves only send what came after it
+    uint64_t saved_watermark = 0;
+
+    // Added to memory's sequence numbers so a resumed run continues the stored numbering
+    uint64_t seq_base = 0;
 };
@@ -0,0 +1,956 @@
+#include "Kernels.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts every intrinsic without per-function flags; GCC and Clang need a target attribute
+#if defined(KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KERNEL_TARGET(isa)
+#endif
+
+namespace {
+
+    // Block sizes chosen so a block of B (BLOCK_K x BLOCK_N floats) stays in L1/L2
+    const int BLOCK_M = 64;
+    const int BLOCK_N = 256;
+    const int BLOCK_K = 128;
+
+    // Primitives for one instruction set
+    struct KernelTable {
+        kernels::Isa isa;
+        void (*axpy)(int n, float a, const float* x, float* y);
+        float (*dot)(int n, const float* x, const float* y);
+        void (*add_bias)(int n, const float* bias, float* y);
+        void (*add_bias_relu)(int n, const float* bias, float* y);
+        void (*relu_backward)(int n, const float* activation, float* delta);
+        void (*adam_update)(int n, float step_size, float beta1, float beta2, float eps, float scale,
+            const float* grad, float* m, float* v, float* w);
+        void (*rmsprop_update)(int n, float lr, float rho, float eps, float scale,
+            const float* grad, float* v, float* w);
+
+        // One cache block of a matrix product, register tiled.
+        // gemm_block: C[m x n] += A * B[k x n], where A(i, p) = a[i * a_rs + p * a_cs] (gemm_nn and gemm_tn)
+        void (*gemm_block)(int m, int n, int k, const float* a, size_t a_rs, size_t a_cs,
+            const float* b, int ldb, float* c, int ldc);
+        // gemm_nt_block: C[m x k] += A[m x n] * B[k x n]^T
+        void (*gemm_nt_block)(int m, int n, int k, const float* a, int lda, const float* b, int ldb, float* c, int ldc);
+    };
+
+    // ----------------- Scalar -----------------
+
+    void axpy_scalar(int n, float a, const float* x, float* y) {
+        for (int j = 0; j < n; ++j)
+            y[j] += a * x[j];
+    }
+
+    float dot_scalar(int n, const float* x, const float* y) {
+        float sum = 0.0f;
+        for (int j = 0; j < n; ++j)
+            sum += x[j] * y[j];
+        return sum;
+    }
+
+    void add_bias_scalar(int n, const float* bias, float* y) {
+        for (int j = 0; j < n; ++j)
+            y[j] += bias[j];
+    }
+
+    void add_bias_relu_scalar(int n, const float* bias, float* y) {
+        for (int j = 0; j < n; ++j) {
+            float v = y[j] + bias[j];
+            y[j] = v > 0 ? v : 0;
+        }
+    }
+
+    void relu_backward_scalar(int n, const float* activation, float* delta) {
+        for (int j = 0; j < n; ++j)
+            if (!(activation[j] > 0)) delta[j] = 0.0f;
+    }
+
+    void adam_update_scalar(int n, float step_size, float beta1, float beta2, float eps, float scale,
+        const float* grad, float* m, float* v, float* w)
+    {
+        for (int j = 0; j < n; ++j) {
+            float g = scale * grad[j];
+            m[j] = beta1 * m[j] + (1.0f - beta1) * g;
+            v[j] = beta2 * v[j] + (1.0f - beta2) * g * g;
+            w[j] += step_size * m[j] / (std::sqrt(v[j]) + eps);
+        }
+    }
+
+    void rmsprop_update_scalar(int n, float lr, float rho, float eps, float scale,
+        const float* grad, float* v, float* w)
+    {
+        for (int j = 0; j < n; ++j) {
+            float g = scale * grad[j];
+            v[j] = rho * v[j] + (1.0f - rho) * g * g;
+            w[j] += lr * g / (std::sqrt(v[j]) + eps);
+        }
+    }
+
+    // R rows of C in R x 4 accumulators; the SIMD versions fall back to this for column tails
+    template <int R>
+    void gemm_rows_scalar(int n, int k, const float* a, size_t rs, size_t cs, const float* b, int ldb, float* c, int ldc) {
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            float acc[R][4];
+            for (int r = 0; r < R; ++r)
+                for (int s = 0; s < 4; ++s) acc[r][s] = c[(size_t)r * ldc + j + s];
+            for (int p = 0; p < k; ++p) {
+                const float* bp = b + (size_t)p * ldb + j;
+                for (int r = 0; r < R; ++r) {
+                    float ar = a[r * rs + p * cs];
+                    for (int s = 0; s < 4; ++s) acc[r][s] += ar * bp[s];
+                }
+            }
+            for (int r = 0; r < R; ++r)
+                for (int s = 0; s < 4; ++s) c[(size_t)r * ldc + j + s] = acc[r][s];
+        }
+        for (; j < n; ++j)
+            for (int r = 0; r < R; ++r) {
+                float sum = c[(size_t)r * ldc + j];
+                for (int p = 0; p < k; ++p) sum += a[r * rs + p * cs] * b[(size_t)p * ldb + j];
+                c[(size_t)r * ldc + j] = sum;
+            }
+    }
+
+    void gemm_block_scalar(int m, int n, int k, const float* a, size_t rs, size_t cs,
+        const float* b, int ldb, float* c, int ldc)
+    {
+        int i = 0;
+        for (; i + 4 <= m; i += 4)
+            gemm_rows_scalar<4>(n, k, a + i * rs, rs, cs, b, ldb, c + (size_t)i * ldc, ldc);
+        for (; i < m; ++i)
+            gemm_rows_scalar<1>(n, k, a + i * rs, rs, cs, b, ldb, c + (size_t)i * ldc, ldc);
+    }
+
+    // R rows of A against S rows of B: R x S dot products over the n shared columns
+    template <int R, int S>
+    void gemm_nt_tile_scalar(int n, const float* a, int lda, const float* b, int ldb, float* c, int ldc) {
+        float acc[R][S] = {};
+        for (int j = 0; j < n; ++j)
+            for (int r = 0; r < R; ++r)
+                for (int s = 0; s < S; ++s) acc[r][s] += a[(size_t)r * lda + j] * b[(size_t)s * ldb + j];
+        for (int r = 0; r < R; ++r)
+            for (int s = 0; s < S; ++s) c[(size_t)r * ldc + s] += acc[r][s];
+    }
+
+    // Tiles every R x S block of C with the given tile kernels; shared by all instruction sets
+    template <void (*T42)(int, const float*, int, const float*, int, float*, int),
+        void (*T41)(int, const float*, int, const float*, int, float*, int),
+        void (*T12)(int, const float*, int, const float*, int, float*, int),
+        void (*T11)(int, const float*, int, const float*, int, float*, int)>
+    void gemm_nt_tiles(int m, int n, int k, const float* a, int lda, const float* b, int ldb, float* c, int ldc) {
+        int i = 0;
+        for (; i + 4 <= m; i += 4) {
+            const float* ai = a + (size_t)i * lda;
+            float* ci = c + (size_t)i * ldc;
+            int p = 0;
+            for (; p + 2 <= k; p += 2) T42(n, ai, lda, b + (size_t)p * ldb, ldb, ci + p, ldc);
+            if (p < k) T41(n, ai, lda, b + (size_t)p * ldb, ldb, ci + p, ldc);
+        }
+        for (; i < m; ++i) {
+            const float* ai = a + (size_t)i * lda;
+            float* ci = c + (size_t)i * ldc;
+            int p = 0;
+            for (; p + 2 <= k; p += 2) T12(n, ai, lda, b + (size_t)p * ldb, ldb, ci + p, ldc);
+            if (p < k) T11(n, ai, lda, b + (size_t)p * ldb, ldb, ci + p, ldc);
+        }
+    }
+
+    void gemm_nt_block_scalar(int m, int n, int k, const float* a, int lda, const float* b, int ldb, float* c, int ldc) {
+        gemm_nt_tiles<gemm_nt_tile_scalar<4, 2>, gemm_nt_tile_scalar<4, 1>, gemm_nt_tile_scalar<1, 2>,
+            gemm_nt_tile_scalar<1, 1>>(m, n, k, a, lda, b, ldb, c, ldc);
+    }
+
+    const KernelTable scalar_table = { kernels::Isa::Scalar,
+        axpy_scalar, dot_scalar, add_bias_scalar, add_bias_relu_scalar, relu_backward_scalar,
+        adam_update_scalar, rmsprop_update_scalar, gemm_block_scalar, gemm_nt_block_scalar };
+
+#ifdef KERNELS_X86
+
+    // ----------------- SSE4 -----------------
+
+    KERNEL_TARGET("sse4.1")
+    void axpy_sse4(int n, float a, const float* x, float* y) {
+        __m128 va = _mm_set1_ps(a);
+        int j = 0;
+        for (; j + 4 <= n; j += 4)
+            _mm_storeu_ps(y + j, _mm_add_ps(_mm_loadu_ps(y + j), _mm_mul_ps(va, _mm_loadu_ps(x + j))));
+        for (; j < n; ++j)
+            y[j] += a * x[j];
+    }
+
+    KERNEL_TARGET("sse4.1")
+    float dot_sse4(int n, const float* x, const float* y) {
+        __m128 acc = _mm_setzero_ps();
+        int j = 0;
+        for (; j + 4 <= n; j += 4)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + j), _mm_loadu_ps(y + j)));
+        acc = _mm_hadd_ps(acc, acc);
+        acc = _mm_hadd_ps(acc, acc);
+        float sum = _mm_cvtss_f32(acc);
+        for (; j < n; ++j)
+            sum += x[j] * y[j];
+        return sum;
+    }
+
+    KERNEL_TARGET("sse4.1")
+    void add_bias_sse4(int n, const float* bias, float* y) {
+        int j = 0;
+        for (; j + 4 <= n; j += 4)
+            _mm_storeu_ps(y + j, _mm_add_ps(_mm_loadu_ps(y + j), _mm_loadu_ps(bias + j)));
+        for (; j < n; ++j)
+            y[j] += bias[j];
+    }
+
+    KERNEL_TARGET("sse4.1")
+    void add_bias_relu_sse4(int n, const float* bias, float* y) {
+        __m128 zero = _mm_setzero_ps();
+        int j = 0;
+        for (; j + 4 <= n; j += 4)
+            _mm_storeu_ps(y + j, _mm_max_ps(zero, _mm_add_ps(_mm_loadu_ps(y + j), _mm_loadu_ps(bias + j))));
+        for (; j < n; ++j) {
+            float v = y[j] + bias[j];
+            y[j] = v > 0 ? v : 0;
+        }
+    }
+
+    KERNEL_TARGET("sse4.1")
+    void relu_backward_sse4(int n, const float* activation, float* delta) {
+        __m128 zero = _mm_setzero_ps();
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            __m128 mask = _mm_cmpgt_ps(_mm_loadu_ps(activation + j), zero);
+            _mm_storeu_ps(delta + j, _mm_and_ps(_mm_loadu_ps(delta + j), mask));
+        }
+        for (; j < n; ++j)
+            if (!(activation[j] > 0)) delta[j] = 0.0f;
+    }
+
+    KERNEL_TARGET("sse4.1")
+    void adam_update_sse4(int n, float step_size, float beta1, float beta2, float eps, float scale,
+        const float* grad, float* m, float* v, float* w)
+    {
+        __m128 vs = _mm_set1_ps(scale), vstep = _mm_set1_ps(step_size), veps = _mm_set1_ps(eps);
+        __m128 b1 = _mm_set1_ps(beta1), c1 = _mm_set1_ps(1.0f - beta1);
+        __m128 b2 = _mm_set1_ps(beta2), c2 = _mm_set1_ps(1.0f - beta2);
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            __m128 g = _mm_mul_ps(vs, _mm_loadu_ps(grad + j));
+            __m128 mj = _mm_add_ps(_mm_mul_ps(b1, _mm_loadu_ps(m + j)), _mm_mul_ps(c1, g));
+            __m128 vj = _mm_add_ps(_mm_mul_ps(b2, _mm_loadu_ps(v + j)), _mm_mul_ps(c2, _mm_mul_ps(g, g)));
+            __m128 upd = _mm_div_ps(_mm_mul_ps(vstep, mj), _mm_add_ps(_mm_sqrt_ps(vj), veps));
+            _mm_storeu_ps(m + j, mj);
+            _mm_storeu_ps(v + j, vj);
+            _mm_storeu_ps(w + j, _mm_add_ps(_mm_loadu_ps(w + j), upd));
+        }
+        adam_update_scalar(n - j, step_size, beta1, beta2, eps, scale, grad + j, m + j, v + j, w + j);
+    }
+
+    KERNEL_TARGET("sse4.1")
+    void rmsprop_update_sse4(int n, float lr, float rho, float eps, float scale,
+        const float* grad, float* v, float* w)
+    {
+        __m128 vs = _mm_set1_ps(scale), vlr = _mm_set1_ps(lr), veps = _mm_set1_ps(eps);
+        __m128 r = _mm_set1_ps(rho), cr = _mm_set1_ps(1.0f - rho);
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            __m128 g = _mm_mul_ps(vs, _mm_loadu_ps(grad + j));
+            __m128 vj = _mm_add_ps(_mm_mul_ps(r, _mm_loadu_ps(v + j)), _mm_mul_ps(cr, _mm_mul_ps(g, g)));
+            __m128 upd = _mm_div_ps(_mm_mul_ps(vlr, g), _mm_add_ps(_mm_sqrt_ps(vj), veps));
+            _mm_storeu_ps(v + j, vj);
+            _mm_storeu_ps(w + j, _mm_add_ps(_mm_loadu_ps(w + j), upd));
+        }
+        rmsprop_update_scalar(n - j, lr, rho, eps, scale, grad + j, v + j, w + j);
+    }
+
+    KERNEL_TARGET("sse4.1")
+    inline float hsum_sse4(__m128 v) {
+        v = _mm_hadd_ps(v, v);
+        v = _mm_hadd_ps(v, v);
+        return _mm_cvtss_f32(v);
+    }
+
+    // R rows of C, 8 then 4 columns at a time in R x 2 / R x 1 registers
+    template <int R>
+    KERNEL_TARGET("sse4.1")
+    void gemm_rows_sse4(int n, int k, const float* a, size_t rs, size_t cs, const float* b, int ldb, float* c, int ldc) {
+        int j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m128 acc[R][2];
+            for (int r = 0; r < R; ++r) {
+                acc[r][0] = _mm_loadu_ps(c + (size_t)r * ldc + j);
+                acc[r][1] = _mm_loadu_ps(c + (size_t)r * ldc + j + 4);
+            }
+            for (int p = 0; p < k; ++p) {
+                const float* bp = b + (size_t)p * ldb + j;
+                __m128 b0 = _mm_loadu_ps(bp), b1 = _mm_loadu_ps(bp + 4);
+                for (int r = 0; r < R; ++r) {
+                    __m128 ar = _mm_set1_ps(a[r * rs + p * cs]);
+                    acc[r][0] = _mm_add_ps(acc[r][0], _mm_mul_ps(ar, b0));
+                    acc[r][1] = _mm_add_ps(acc[r][1], _mm_mul_ps(ar, b1));
+                }
+            }
+            for (int r = 0; r < R; ++r) {
+                _mm_storeu_ps(c + (size_t)r * ldc + j, acc[r][0]);
+                _mm_storeu_ps(c + (size_t)r * ldc + j + 4, acc[r][1]);
+            }
+        }
+        for (; j + 4 <= n; j += 4) {
+            __m128 acc[R];
+            for (int r = 0; r < R; ++r) acc[r] = _mm_loadu_ps(c + (size_t)r * ldc + j);
+            for (int p = 0; p < k; ++p) {
+                __m128 b0 = _mm_loadu_ps(b + (size_t)p * ldb + j);
+                for (int r = 0; r < R; ++r)
+                    acc[r] = _mm_add_ps(acc[r], _mm_mul_ps(_mm_set1_ps(a[r * rs + p * cs]), b0));
+            }
+            for (int r = 0; r < R; ++r) _mm_storeu_ps(c + (size_t)r * ldc + j, acc[r]);
+        }
+        if (j < n) gemm_rows_scalar<R>(n - j, k, a, rs, cs, b + j, ldb, c + j, ldc);
+    }
+
+    KERNEL_TARGET("sse4.1")
+    void gemm_block_sse4(int m, int n, int k, const float* a, size_t rs, size_t cs,
+        const float* b, int ldb, float* c, int ldc)
+    {
+        int i = 0;
+        for (; i + 4 <= m; i += 4)
+            gemm_rows_sse4<4>(n, k, a + i * rs, rs, cs, b, ldb, c + (size_t)i * ldc, ldc);
+        for (; i < m; ++i)
+            gemm_rows_sse4<1>(n, k, a + i * rs, rs, cs, b, ldb, c + (size_t)i * ldc, ldc);
+    }
+
+    template <int R, int S>
+    KERNEL_TARGET("sse4.1")
+    void gemm_nt_tile_sse4(int n, const float* a, int lda, const float* b, int ldb, float* c, int ldc) {
+        __m128 acc[R][S];
+        for (int r = 0; r < R; ++r)
+            for (int s = 0; s < S; ++s) acc[r][s] = _mm_setzero_ps();
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            __m128 bs[S];
+            for (int s = 0; s < S; ++s) bs[s] = _mm_loadu_ps(b + (size_t)s * ldb + j);
+            for (int r = 0; r < R; ++r) {
+                __m128 ar = _mm_loadu_ps(a + (size_t)r * lda + j);
+                for (int s = 0; s < S; ++s) acc[r][s] = _mm_add_ps(acc[r][s], _mm_mul_ps(ar, bs[s]));
+            }
+        }
+        for (int r = 0; r < R; ++r)
+            for (int s = 0; s < S; ++s) {
+                float sum = hsum_sse4(acc[r][s]);
+                for (int t = j; t < n; ++t) sum += a[(size_t)r * lda + t] * b[(size_t)s * ldb + t];
+                c[(size_t)r * ldc + s] += sum;
+            }
+    }
+
+    KERNEL_TARGET("sse4.1")
+    void gemm_nt_block_sse4(int m, int n, int k, const float* a, int lda, const float* b, int ldb, float* c, int ldc) {
+        gemm_nt_tiles<gemm_nt_tile_sse4<4, 2>, gemm_nt_tile_sse4<4, 1>, gemm_nt_tile_sse4<1, 2>,
+            gemm_nt_tile_sse4<1, 1>>(m, n, k, a, lda, b, ldb, c, ldc);
+    }
+
+    const KernelTable sse4_table = { kernels::Isa::SSE4,
+        axpy_sse4, dot_sse4, add_bias_sse4, add_bias_relu_sse4, relu_backward_sse4,
+        adam_update_sse4, rmsprop_update_sse4, gemm_block_sse4, gemm_nt_block_sse4 };
+
+    // ----------------- AVX2 -----------------
+
+    KERNEL_TARGET("avx2,fma")
+    void axpy_avx2(int n, float a, const float* x, float* y) {
+        __m256 va = _mm256_set1_ps(a);
+        int j = 0;
+        for (; j + 16 <= n; j += 16) {
+            _mm256_storeu_ps(y + j, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j)));
+            _mm256_storeu_ps(y + j + 8, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + j + 8), _mm256_loadu_ps(y + j + 8)));
+        }
+        for (; j + 8 <= n; j += 8)
+            _mm256_storeu_ps(y + j, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j)));
+        for (; j < n; ++j)
+            y[j] += a * x[j];
+    }
+
+    KERNEL_TARGET("avx2,fma")
+    float dot_avx2(int n, const float* x, const float* y) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        int j = 0;
+        for (; j + 16 <= n; j += 16) {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j + 8), _mm256_loadu_ps(y + j + 8), acc1);
+        }
+        for (; j + 8 <= n; j += 8)
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j), acc0);
+        acc0 = _mm256_add_ps(acc0, acc1);
+        __m128 lo = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+        lo = _mm_hadd_ps(lo, lo);
+        lo = _mm_hadd_ps(lo, lo);
+        float sum = _mm_cvtss_f32(lo);
+        for (; j < n; ++j)
+            sum += x[j] * y[j];
+        return sum;
+    }
+
+    KERNEL_TARGET("avx2,fma")
+    void add_bias_avx2(int n, const float* bias, float* y) {
+        int j = 0;
+        for (; j + 8 <= n; j += 8)
+            _mm256_storeu_ps(y + j, _mm256_add_ps(_mm256_loadu_ps(y + j), _mm256_loadu_ps(bias + j)));
+        for (; j < n; ++j)
+            y[j] += bias[j];
+    }
+
+    KERNEL_TARGET("avx2,fma")
+    void add_bias_relu_avx2(int n, const float* bias, float* y) {
+        __m256 zero = _mm256_setzero_ps();
+        int j = 0;
+        for (; j + 8 <= n; j += 8)
+            _mm256_storeu_ps(y + j, _mm256_max_ps(zero, _mm256_add_ps(_mm256_loadu_ps(y + j), _mm256_loadu_ps(bias + j))));
+        for (; j < n; ++j) {
+            float v = y[j] + bias[j];
+            y[j] = v > 0 ? v : 0;
+        }
+    }
+
+    KERNEL_TARGET("avx2,fma")
+    void relu_backward_avx2(int n, const float* activation, float* delta) {
+        __m256 zero = _mm256_setzero_ps();
+        int j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m256 mask = _mm256_cmp_ps(_mm256_loadu_ps(activation + j), zero, _CMP_GT_OQ);
+            _mm256_storeu_ps(delta + j, _mm256_and_ps(_mm256_loadu_ps(delta + j), mask));
+        }
+        for (; j < n; ++j)
+            if (!(activation[j] > 0)) delta[j] = 0.0f;
+    }
+
+    KERNEL_TARGET("avx2,fma")
+    void adam_update_avx2(int n, float step_size, float beta1, float beta2, float eps, float scale,
+        const float* grad, float* m, float* v, float* w)
+    {
+        __m256 vs = _mm256_set1_ps(scale), vstep = _mm256_set1_ps(step_size), veps = _mm256_set1_ps(eps);
+        __m256 b1 = _mm256_set1_ps(beta1), c1 = _mm256_set1_ps(1.0f - beta1);
+        __m256 b2 = _mm256_set1_ps(beta2), c2 = _mm256_set1_ps(1.0f - beta2);
+        int j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m256 g = _mm256_mul_ps(vs, _mm256_loadu_ps(grad + j));
+            __m256 mj = _mm256_fmadd_ps(b1, _mm256_loadu_ps(m + j), _mm256_mul_ps(c1, g));
+            __m256 vj = _mm256_fmadd_ps(b2, _mm256_loadu_ps(v + j), _mm256_mul_ps(c2, _mm256_mul_ps(g, g)));
+            __m256 upd = _mm256_div_ps(_mm256_mul_ps(vstep, mj), _mm256_add_ps(_mm256_sqrt_ps(vj), veps));
+            _mm256_storeu_ps(m + j, mj);
+            _mm256_storeu_ps(v + j, vj);
+            _mm256_storeu_ps(w + j, _mm256_add_ps(_mm256_loadu_ps(w + j), upd));
+        }
+        adam_update_scalar(n - j, step_size, beta1, beta2, eps, scale, grad + j, m + j, v + j, w + j);
+    }
+
+    KERNEL_TARGET("avx2,fma")
+    void rmsprop_update_avx2(int n, float lr, float rho, float eps, float scale,
+        const float* grad, float* v, float* w)
+    {
+        __m256 vs = _mm256_set1_ps(scale), vlr = _mm256_set1_ps(lr), veps = _mm256_set1_ps(eps);
+        __m256 r = _mm256_set1_ps(rho), cr = _mm256_set1_ps(1.0f - rho);
+        int j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m256 g = _mm256_mul_ps(vs, _mm256_loadu_ps(grad + j));
+            __m256 vj = _mm256_fmadd_ps(r, _mm256_loadu_ps(v + j), _mm256_mul_ps(cr, _mm256_mul_ps(g, g)));
+            __m256 upd = _mm256_div_ps(_mm256_mul_ps(vlr, g), _mm256_add_ps(_mm256_sqrt_ps(vj), veps));
+            _mm256_storeu_ps(v + j, vj);
+            _mm256_storeu_ps(w + j, _mm256_add_ps(_mm256_loadu_ps(w + j), upd));
+        }
+        rmsprop_update_scalar(n - j, lr, rho, eps, scale, grad + j, v + j, w + j);
+    }
+
+    KERNEL_TARGET("avx2,fma")
+    inline float hsum_avx2(__m256 v) {
+        __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        lo = _mm_hadd_ps(lo, lo);
+        lo = _mm_hadd_ps(lo, lo);
+        return _mm_cvtss_f32(lo);
+    }
+
+    // R rows of C, 16 then 8 columns at a time in R x 2 / R x 1 registers
+    template <int R>
+    KERNEL_TARGET("avx2,fma")
+    void gemm_rows_avx2(int n, int k, const float* a, size_t rs, size_t cs, const float* b, int ldb, float* c, int ldc) {
+        int j = 0;
+        for (; j + 16 <= n; j += 16) {
+            __m256 acc[R][2];
+            for (int r = 0; r < R; ++r) {
+                acc[r][0] = _mm256_loadu_ps(c + (size_t)r * ldc + j);
+                acc[r][1] = _mm256_loadu_ps(c + (size_t)r * ldc + j + 8);
+            }
+            for (int p = 0; p < k; ++p) {
+                const float* bp = b + (size_t)p * ldb + j;
+                __m256 b0 = _mm256_loadu_ps(bp), b1 = _mm256_loadu_ps(bp + 8);
+                for (int r = 0; r < R; ++r) {
+                    __m256 ar = _mm256_set1_ps(a[r * rs + p * cs]);
+                    acc[r][0] = _mm256_fmadd_ps(ar, b0, acc[r][0]);
+                    acc[r][1] = _mm256_fmadd_ps(ar, b1, acc[r][1]);
+                }
+            }
+            for (int r = 0; r < R; ++r) {
+                _mm256_storeu_ps(c + (size_t)r * ldc + j, acc[r][0]);
+                _mm256_storeu_ps(c + (size_t)r * ldc + j + 8, acc[r][1]);
+            }
+        }
+        for (; j + 8 <= n; j += 8) {
+            __m256 acc[R];
+            for (int r = 0; r < R; ++r) acc[r] = _mm256_loadu_ps(c + (size_t)r * ldc + j);
+            for (int p = 0; p < k; ++p) {
+                __m256 b0 = _mm256_loadu_ps(b + (size_t)p * ldb + j);
+                for (int r = 0; r < R; ++r)
+                    acc[r] = _mm256_fmadd_ps(_mm256_set1_ps(a[r * rs + p * cs]), b0, acc[r]);
+            }
+            for (int r = 0; r < R; ++r) _mm256_storeu_ps(c + (size_t)r * ldc + j, acc[r]);
+        }
+        if (j < n) gemm_rows_scalar<R>(n - j, k, a, rs, cs, b + j, ldb, c + j, ldc);
+    }
+
+    KERNEL_TARGET("avx2,fma")
+    void gemm_block_avx2(int m, int n, int k, const float* a, size_t rs, size_t cs,
+        const float* b, int ldb, float* c, int ldc)
+    {
+        int i = 0;
+        for (; i + 4 <= m; i += 4)
+            gemm_rows_avx2<4>(n, k, a + i * rs, rs, cs, b, ldb, c + (size_t)i * ldc, ldc);
+        for (; i < m; ++i)
+            gemm_rows_avx2<1>(n, k, a + i * rs, rs, cs, b, ldb, c + (size_t)i * ldc, ldc);
+    }
+
+    template <int R, int S>
+    KERNEL_TARGET("avx2,fma")
+    void gemm_nt_tile_avx2(int n, const float* a, int lda, const float* b, int ldb, float* c, int ldc) {
+        __m256 acc[R][S];
+        for (int r = 0; r < R; ++r)
+            for (int s = 0; s < S; ++s) acc[r][s] = _mm256_setzero_ps();
+        int j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m256 bs[S];
+            for (int s = 0; s < S; ++s) bs[s] = _mm256_loadu_ps(b + (size_t)s * ldb + j);
+            for (int r = 0; r < R; ++r) {
+                __m256 ar = _mm256_loadu_ps(a + (size_t)r * lda + j);
+                for (int s = 0; s < S; ++s) acc[r][s] = _mm256_fmadd_ps(ar, bs[s], acc[r][s]);
+            }
+        }
+        for (int r = 0; r < R; ++r)
+            for (int s = 0; s < S; ++s) {
+                float sum = hsum_avx2(acc[r][s]);
+                for (int t = j; t < n; ++t) sum += a[(size_t)r * lda + t] * b[(size_t)s * ldb + t];
+                c[(size_t)r * ldc + s] += sum;
+            }
+    }
+
+    KERNEL_TARGET("avx2,fma")
+    void gemm_nt_block_avx2(int m, int n, int k, const float* a, int lda, const float* b, int ldb, float* c, int ldc) {
+        gemm_nt_tiles<gemm_nt_tile_avx2<4, 2>, gemm_nt_tile_avx2<4, 1>, gemm_nt_tile_avx2<1, 2>,
+            gemm_nt_tile_avx2<1, 1>>(m, n, k, a, lda, b, ldb, c, ldc);
+    }
+
+    const KernelTable avx2_table = { kernels::Isa::AVX2,
+        axpy_avx2, dot_avx2, add_bias_avx2, add_bias_relu_avx2, relu_backward_avx2,
+        adam_update_avx2, rmsprop_update_avx2, gemm_block_avx2, gemm_nt_block_avx2 };
+
+    // ----------------- AVX-512 -----------------
+    // Tails use masked loads/stores, so there is no scalar remainder loop
+
+    KERNEL_TARGET("avx512f")
+    void axpy_avx512(int n, float a, const float* x, float* y) {
+        __m512 va = _mm512_set1_ps(a);
+        int j = 0;
+        for (; j + 16 <= n; j += 16)
+            _mm512_storeu_ps(y + j, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + j), _mm512_loadu_ps(y + j)));
+        if (j < n) {
+            __mmask16 m = (__mmask16)((1u << (n - j)) - 1);
+            __m512 vy = _mm512_maskz_loadu_ps(m, y + j);
+            _mm512_mask_storeu_ps(y + j, m, _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + j), vy));
+        }
+    }
+
+    KERNEL_TARGET("avx512f")
+    float dot_avx512(int n, const float* x, const float* y) {
+        __m512 acc = _mm512_setzero_ps();
+        int j = 0;
+        for (; j + 16 <= n; j += 16)
+            acc = _mm512_fmadd_ps(_mm512_loadu_ps(x + j), _mm512_loadu_ps(y + j), acc);
+        if (j < n) {
+            __mmask16 m = (__mmask16)((1u << (n - j)) - 1);
+            acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, x + j), _mm512_maskz_loadu_ps(m, y + j), acc);
+        }
+        float lanes[16];
+        _mm512_storeu_ps(lanes, acc);
+        float sum = 0.0f;
+        for (int i = 0; i < 16; ++i)
+            sum += lanes[i];
+        return sum;
+    }
+
+    KERNEL_TARGET("avx512f")
+    void add_bias_avx512(int n, const float* bias, float* y) {
+        int j = 0;
+        for (; j + 16 <= n; j += 16)
+            _mm512_storeu_ps(y + j, _mm512_add_ps(_mm512_loadu_ps(y + j), _mm512_loadu_ps(bias + j)));
+        if (j < n) {
+            __mmask16 m = (__mmask16)((1u << (n - j)) - 1);
+            _mm512_mask_storeu_ps(y + j, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, y + j), _mm512_maskz_loadu_ps(m, bias + j)));
+        }
+    }
+
+    KERNEL_TARGET("avx512f")
+    void add_bias_relu_avx512(int n, const float* bias, float* y) {
+        __m512 zero = _mm512_setzero_ps();
+        int j = 0;
+        for (; j + 16 <= n; j += 16) {
+            __m512 v = _mm512_add_ps(_mm512_loadu_ps(y + j), _mm512_loadu_ps(bias + j));
+            _mm512_storeu_ps(y + j, _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(v, zero, _CMP_GT_OQ), v));
+        }
+        if (j < n) {
+            __mmask16 m = (__mmask16)((1u << (n - j)) - 1);
+            __m512 v = _mm512_add_ps(_mm512_maskz_loadu_ps(m, y + j), _mm512_maskz_loadu_ps(m, bias + j));
+            _mm512_mask_storeu_ps(y + j, m, _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(v, zero, _CMP_GT_OQ), v));
+        }
+    }
+
+    KERNEL_TARGET("avx512f")
+    void relu_backward_avx512(int n, const float* activation, float* delta) {
+        __m512 zero = _mm512_setzero_ps();
+        int j = 0;
+        for (; j + 16 <= n; j += 16) {
+            __mmask16 keep = _mm512_cmp_ps_mask(_mm512_loadu_ps(activation + j), zero, _CMP_GT_OQ);
+            _mm512_storeu_ps(delta + j, _mm512_maskz_loadu_ps(keep, delta + j));
+        }
+        if (j < n) {
+            __mmask16 m = (__mmask16)((1u << (n - j)) - 1);
+            __mmask16 keep = _mm512_mask_cmp_ps_mask(m, _mm512_maskz_loadu_ps(m, activation + j), zero, _CMP_GT_OQ);
+            _mm512_mask_storeu_ps(delta + j, m, _mm512_maskz_loadu_ps(keep, delta + j));
+        }
+    }
+
+    KERNEL_TARGET("avx512f")
+    void adam_update_avx512(int n, float step_size, float beta1, float beta2, float eps, float scale,
+        const float* grad, float* m, float* v, float* w)
+    {
+        __m512 vs = _mm512_set1_ps(scale), vstep = _mm512_set1_ps(step_size), veps = _mm512_set1_ps(eps);
+        __m512 b1 = _mm512_set1_ps(beta1), c1 = _mm512_set1_ps(1.0f - beta1);
+        __m512 b2 = _mm512_set1_ps(beta2), c2 = _mm512_set1_ps(1.0f - beta2);
+        for (int j = 0; j < n; j += 16) {
+            __mmask16 k = n - j >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - j)) - 1);
+            __m512 g = _mm512_mul_ps(vs, _mm512_maskz_loadu_ps(k, grad + j));
+            __m512 mj = _mm512_fmadd_ps(b1, _mm512_maskz_loadu_ps(k, m + j), _mm512_mul_ps(c1, g));
+            __m512 vj = _mm512_fmadd_ps(b2, _mm512_maskz_loadu_ps(k, v + j), _mm512_mul_ps(c2, _mm512_mul_ps(g, g)));
+            __m512 upd = _mm512_div_ps(_mm512_mul_ps(vstep, mj), _mm512_add_ps(_mm512_maskz_sqrt_ps(k, vj), veps));
+            _mm512_mask_storeu_ps(m + j, k, mj);
+            _mm512_mask_storeu_ps(v + j, k, vj);
+            _mm512_mask_storeu_ps(w + j, k, _mm512_add_ps(_mm512_maskz_loadu_ps(k, w + j), upd));
+        }
+    }
+
+    KERNEL_TARGET("avx512f")
+    void rmsprop_update_avx512(int n, float lr, float rho, float eps, float scale,
+        const float* grad, float* v, float* w)
+    {
+        __m512 vs = _mm512_set1_ps(scale), vlr = _mm512_set1_ps(lr), veps = _mm512_set1_ps(eps);
+        __m512 r = _mm512_set1_ps(rho), cr = _mm512_set1_ps(1.0f - rho);
+        for (int j = 0; j < n; j += 16) {
+            __mmask16 k = n - j >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - j)) - 1);
+            __m512 g = _mm512_mul_ps(vs, _mm512_maskz_loadu_ps(k, grad + j));
+            __m512 vj = _mm512_fmadd_ps(r, _mm512_maskz_loadu_ps(k, v + j), _mm512_mul_ps(cr, _mm512_mul_ps(g, g)));
+            __m512 upd = _mm512_div_ps(_mm512_mul_ps(vlr, g), _mm512_add_ps(_mm512_maskz_sqrt_ps(k, vj), veps));
+            _mm512_mask_storeu_ps(v + j, k, vj);
+            _mm512_mask_storeu_ps(w + j, k, _mm512_add_ps(_mm512_maskz_loadu_ps(k, w + j), upd));
+        }
+    }
+
+    KERNEL_TARGET("avx512f")
+    inline float hsum_avx512(__m512 v) {
+        float lanes[16];
+        _mm512_storeu_ps(lanes, v);
+        float sum = 0.0f;
+        for (int i = 0; i < 16; ++i)
+            sum += lanes[i];
+        return sum;
+    }
+
+    KERNEL_TARGET("avx512f")
+    inline __mmask16 tail_mask(int count) {
+        return count >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << count) - 1);
+    }
+
+    // R rows of C, 32 columns at a time in R x 2 registers, then one masked 16-column vector
+    template <int R>
+    KERNEL_TARGET("avx512f")
+    void gemm_rows_avx512(int n, int k, const float* a, size_t rs, size_t cs, const float* b, int ldb, float* c, int ldc) {
+        int j = 0;
+        for (; j + 32 <= n; j += 32) {
+            __m512 acc[R][2];
+            for (int r = 0; r < R; ++r) {
+                acc[r][0] = _mm512_loadu_ps(c + (size_t)r * ldc + j);
+                acc[r][1] = _mm512_loadu_ps(c + (size_t)r * ldc + j + 16);
+            }
+            for (int p = 0; p < k; ++p) {
+                const float* bp = b + (size_t)p * ldb + j;
+                __m512 b0 = _mm512_loadu_ps(bp), b1 = _mm512_loadu_ps(bp + 16);
+                for (int r = 0; r < R; ++r) {
+                    __m512 ar = _mm512_set1_ps(a[r * rs + p * cs]);
+                    acc[r][0] = _mm512_fmadd_ps(ar, b0, acc[r][0]);
+                    acc[r][1] = _mm512_fmadd_ps(ar, b1, acc[r][1]);
+                }
+            }
+            for (int r = 0; r < R; ++r) {
+                _mm512_storeu_ps(c + (size_t)r * ldc + j, acc[r][0]);
+                _mm512_storeu_ps(c + (size_t)r * ldc + j + 16, acc[r][1]);
+            }
+        }
+        for (; j < n; j += 16) {
+            __mmask16 mask = tail_mask(n - j);
+            __m512 acc[R];
+            for (int r = 0; r < R; ++r) acc[r] = _mm512_maskz_loadu_ps(mask, c + (size_t)r * ldc + j);
+            for (int p = 0; p < k; ++p) {
+                __m512 b0 = _mm512_maskz_loadu_ps(mask, b + (size_t)p * ldb + j);
+                for (int r = 0; r < R; ++r)
+                    acc[r] = _mm512_fmadd_ps(_mm512_set1_ps(a[r * rs + p * cs]), b0, acc[r]);
+            }
+            for (int r = 0; r < R; ++r) _mm512_mask_storeu_ps(c + (size_t)r * ldc + j, mask, acc[r]);
+        }
+    }
+
+    KERNEL_TARGET("avx512f")
+    void gemm_block_avx512(int m, int n, int k, const float* a, size_t rs, size_t cs,
+        const float* b, int ldb, float* c, int ldc)
+    {
+        int i = 0;
+        for (; i + 4 <= m; i += 4)
+            gemm_rows_avx512<4>(n, k, a + i * rs, rs, cs, b, ldb, c + (size_t)i * ldc, ldc);
+        for (; i < m; ++i)
+            gemm_rows_avx512<1>(n, k, a + i * rs, rs, cs, b, ldb, c + (size_t)i * ldc, ldc);
+    }
+
+    template <int R, int S>
+    KERNEL_TARGET("avx512f")
+    void gemm_nt_tile_avx512(int n, const float* a, int lda, const float* b, int ldb, float* c, int ldc) {
+        __m512 acc[R][S];
+        for (int r = 0; r < R; ++r)
+            for (int s = 0; s < S; ++s) acc[r][s] = _mm512_setzero_ps();
+        for (int j = 0; j < n; j += 16) {
+            __mmask16 mask = tail_mask(n - j);
+            __m512 bs[S];
+            for (int s = 0; s < S; ++s) bs[s] = _mm512_maskz_loadu_ps(mask, b + (size_t)s * ldb + j);
+            for (int r = 0; r < R; ++r) {
+                __m512 ar = _mm512_maskz_loadu_ps(mask, a + (size_t)r * lda + j);
+                for (int s = 0; s < S; ++s) acc[r][s] = _mm512_fmadd_ps(ar, bs[s], acc[r][s]);
+            }
+        }
+        for (int r = 0; r < R; ++r)
+            for (int s = 0; s < S; ++s) c[(size_t)r * ldc + s] += hsum_avx512(acc[r][s]);
+    }
+
+    KERNEL_TARGET("avx512f")
+    void gemm_nt_block_avx512(int m, int n, int k, const float* a, int lda, const float* b, int ldb, float* c, int ldc) {
+        gemm_nt_tiles<gemm_nt_tile_avx512<4, 2>, gemm_nt_tile_avx512<4, 1>, gemm_nt_tile_avx512<1, 2>,
+            gemm_nt_tile_avx512<1, 1>>(m, n, k, a, lda, b, ldb, c, ldc);
+    }
+
+    const KernelTable avx512_table = { kernels::Isa::AVX512,
+        axpy_avx512, dot_avx512, add_bias_avx512, add_bias_relu_avx512, relu_backward_avx512,
+        adam_update_avx512, rmsprop_update_avx512, gemm_block_avx512, gemm_nt_block_avx512 };
+
+    // ----------------- CPU detection -----------------
+
+#ifdef _MSC_VER
+    bool os_saves_ymm() {
+        int info[4];
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        return osxsave && (_xgetbv(0) & 0x6) == 0x6;
+    }
+
+    bool cpu_supports(kernels::Isa isa) {
+        int info[4];
+        __cpuid(info, 0);
+        int max_leaf = info[0];
+        __cpuid(info, 1);
+        bool sse41 = (info[2] & (1 << 19)) != 0;
+        bool fma = (info[2] & (1 << 12)) != 0;
+        if (isa == kernels::Isa::SSE4) return sse41;
+        if (max_leaf < 7 || !os_saves_ymm()) return false;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        bool avx512f = (info[1] & (1 << 16)) != 0;
+        if (isa == kernels::Isa::AVX2) return avx2 && fma;
+        if (isa == kernels::Isa::AVX512) return avx512f && (_xgetbv(0) & 0xE6) == 0xE6;
+        return true;
+    }
+#else
+    bool cpu_supports(kernels::Isa isa) {
+        __builtin_cpu_init();
+        switch (isa) {
+        case kernels::Isa::SSE4:   return __builtin_cpu_supports("sse4.1");
+        case kernels::Isa::AVX2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case kernels::Isa::AVX512: return __builtin_cpu_supports("avx512f");
+        default:                   return true;
+        }
+    }
+#endif
+
+    const KernelTable* table_for(kernels::Isa isa) {
+        if (isa >= kernels::Isa::AVX512 && cpu_supports(kernels::Isa::AVX512)) return &avx512_table;
+        if (isa >= kernels::Isa::AVX2 && cpu_supports(kernels::Isa::AVX2)) return &avx2_table;
+        if (isa >= kernels::Isa::SSE4 && cpu_supports(kernels::Isa::SSE4)) return &sse4_table;
+        return &scalar_table;
+    }
+
+#else
+
+    const KernelTable* table_for(kernels::Isa) {
+        return &scalar_table;
+    }
+
+#endif
+
+    // Index of the lowest set bit of a non-zero word
+    int lowest_bit(uint64_t b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanForward64(&index, b);
+        return (int)index;
+#elif defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(b);
+#else
+        int index = 0;
+        while (!(b & 1)) { b >>= 1; ++index; }
+        return index;
+#endif
+    }
+
+    const KernelTable*& active_table() {
+        static const KernelTable* table = table_for(kernels::Isa::AVX512);
+        return table;
+    }
+}
+
+namespace kernels {
+
+    Isa active_isa() {
+        return active_table()->isa;
+    }
+
+    const char* isa_name(Isa isa) {
+        switch (isa) {
+        case Isa::SSE4:   return "SSE4";
+        case Isa::AVX2:   return "AVX2";
+        case Isa::AVX512: return "AVX-512";
+        default:          return "scalar";
+        }
+    }
+
+    Isa set_isa(Isa isa) {
+        active_table() = table_for(isa);
+        return active_table()->isa;
+    }
+
+    void axpy(int n, float a, const float* x, float* y) {
+        active_table()->axpy(n, a, x, y);
+    }
+
+    float dot(int n, const float* x, const float* y) {
+        return active_table()->dot(n, x, y);
+    }
+
+    void add_bias(int rows, int n, const float* bias, float* y) {
+        const KernelTable* t = active_table();
+        for (int i = 0; i < rows; ++i)
+            t->add_bias(n, bias, y + (size_t)i * n);
+    }
+
+    void add_bias_relu(int rows, int n, const float* bias, float* y) {
+        const KernelTable* t = active_table();
+        for (int i = 0; i < rows; ++i)
+            t->add_bias_relu(n, bias, y + (size_t)i * n);
+    }
+
+    void relu_backward(int n, const float* activation, float* delta) {
+        active_table()->relu_backward(n, activation, delta);
+    }
+
+    void add_rows_masked(int rows, int n, const uint64_t* bits, const float* w, float* y) {
+        const KernelTable* t = active_table();
+        for (int word = 0; word * 64 < rows; ++word) {
+            // Visit only the set bits, lowest first
+            for (uint64_t b = bits[word]; b; b &= b - 1) {
+                int i = word * 64 + lowest_bit(b);
+                if (i >= rows) break;
+                t->axpy(n, 1.0f, w + (size_t)i * n, y);
+            }
+        }
+    }
+
+    void adam_update(int n, float step_size, float beta1, float beta2, float eps, float scale,
+        const float* grad, float* m, float* v, float* w)
+    {
+        active_table()->adam_update(n, step_size, beta1, beta2, eps, scale, grad, m, v, w);
+    }
+
+    void rmsprop_update(int n, float lr, float rho, float eps, float scale,
+        const float* grad, float* v, float* w)
+    {
+        active_table()->rmsprop_update(n, lr, rho, eps, scale, grad, v, w);
+    }
+
+    // The drivers only cut the product into cache blocks; each block is one call into the
+    // active instruction set's register-tiled kernel
+
+    void gemm_nn(int m, int n, int k, const float* a, const float* b, float* c) {
+        const KernelTable* t = active_table();
+        for (int i0 = 0; i0 < m; i0 += BLOCK_M) {
+            int mb = std::min(BLOCK_M, m - i0);
+            for (int p0 = 0; p0 < k; p0 += BLOCK_K) {
+                int kb = std::min(BLOCK_K, k - p0);
+                for (int j0 = 0; j0 < n; j0 += BLOCK_N) {
+                    int nb = std::min(BLOCK_N, n - j0);
+                    t->gemm_block(mb, nb, kb, a + (size_t)i0 * k + p0, (size_t)k, 1,
+                        b + (size_t)p0 * n + j0, n, c + (size_t)i0 * n + j0, n);
+                }
+            }
+        }
+    }
+
+    // C^T's rows are A's columns: the same block kernel with A read through swapped strides
+    void gemm_tn(int m, int n, int k, const float* a, const float* b, float* c) {
+        const KernelTable* t = active_table();
+        for (int p0 = 0; p0 < k; p0 += BLOCK_M) {
+            int pb = std::min(BLOCK_M, k - p0);
+            for (int i0 = 0; i0 < m; i0 += BLOCK_K) {
+                int ib = std::min(BLOCK_K, m - i0);
+                for (int j0 = 0; j0 < n; j0 += BLOCK_N) {
+                    int nb = std::min(BLOCK_N, n - j0);
+                    t->gemm_block(pb, nb, ib, a + (size_t)i0 * k + p0, 1, (size_t)k,
+                        b + (size_t)i0 * n + j0, n, c + (size_t)p0 * n + j0, n);
+                }
+            }
+        }
+    }
+
+    void gemm_nt(int m, int n, int k, const float* a, const float* b, float* c) {
+        const KernelTable* t = active_table();
+        for (int i0 = 0; i0 < m; i0 += BLOCK_M) {
+            int mb = std::min(BLOCK_M, m - i0);
+            for (int p0 = 0; p0 < k; p0 += BLOCK_K) {
+                int kb = std::min(BLOCK_K, k - p0);
+                for (int j0 = 0; j0 < n; j0 += BLOCK_N) {
+                    int nb = std::min(BLOCK_N, n - j0);
+                    t->gemm_nt_block(mb, nb, kb, a + (size_t)i0 * n + j0, n,
+                        b + (size_t)p0 * n + j0, n, c + (size_t)i0 * k + p0, k);
+                }
+            }
+        }
+    }
+}
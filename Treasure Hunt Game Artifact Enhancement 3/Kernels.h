@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Dense linear algebra kernels used by the DQN layers.
+// All matrices are row-major and tightly packed (leading dimension == column count).
+// The element-wise primitives have scalar, SSE4, AVX2 and AVX-512 versions;
+// the best one the CPU supports is picked the first time a kernel is used.
+namespace kernels {
+
+    enum class Isa { Scalar, SSE4, AVX2, AVX512 };
+
+    // Instruction set currently in use
+    Isa active_isa();
+    const char* isa_name(Isa isa);
+
+    // Force a specific instruction set (clamped to what the CPU supports); returns the one selected
+    Isa set_isa(Isa isa);
+
+    // y[n] += a * x[n]
+    void axpy(int n, float a, const float* x, float* y);
+
+    // returns x[n] . y[n]
+    float dot(int n, const float* x, const float* y);
+
+    // y[rows x n] += bias[n] on every row
+    void add_bias(int rows, int n, const float* bias, float* y);
+
+    // y[rows x n] = max(0, y + bias[n]) on every row
+    void add_bias_relu(int rows, int n, const float* bias, float* y);
+
+    // delta[n] *= (activation[n] > 0)
+    void relu_backward(int n, const float* activation, float* delta);
+
+    // y[n] += sum of the rows i of W[rows x n] whose bit i is set in bits[(rows + 63) / 64]
+    void add_rows_masked(int rows, int n, const uint64_t* bits, const float* w, float* y);
+
+    // Fused Adam step over n parameters in one pass, with g = scale * grad[n] as the ascent direction:
+    // m = beta1*m + (1-beta1)*g;  v = beta2*v + (1-beta2)*g*g;  w += step_size * m / (sqrt(v) + eps).
+    // step_size already carries the bias correction lr * sqrt(1-beta2^t) / (1-beta1^t)
+    void adam_update(int n, float step_size, float beta1, float beta2, float eps, float scale,
+        const float* grad, float* m, float* v, float* w);
+
+    // Fused RMSProp step: v = rho*v + (1-rho)*g*g;  w += lr * g / (sqrt(v) + eps), g = scale * grad[n]
+    void rmsprop_update(int n, float lr, float rho, float eps, float scale,
+        const float* grad, float* v, float* w);
+
+    // C[m x n] += A[m x k] * B[k x n]
+    void gemm_nn(int m, int n, int k, const float* a, const float* b, float* c);
+
+    // C[k x n] += A^T * B, where A is [m x k] and B is [m x n]
+    void gemm_tn(int m, int n, int k, const float* a, const float* b, float* c);
+
+    // C[m x k] += A * B^T, where A is [m x n] and B is [k x n]
+    void gemm_nt(int m, int n, int k, const float* a, const float* b, float* c);
+
+    // y[n] += x[k] * W[k x n]
+    inline void gemv(int n, int k, const float* x, const float* w, float* y) {
+        gemm_nn(1, n, k, x, w, y);
+    }
+}
@@ -0,0 +1,90 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(f, &file_size)) {
+        CloseHandle(f);
+        return false;
+    }
+    file = f;
+    size_ = (size_t)file_size.QuadPart;
+    if (size_ == 0) return true; // nothing to map
+
+    mapping = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) data_ = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data_) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+    data_ = nullptr;
+    mapping = nullptr;
+    file = nullptr;
+    size_ = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size_ = (size_t)st.st_size;
+    if (size_ == 0) {
+        ::close(fd);
+        return true; // nothing to map
+    }
+
+    void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (p == MAP_FAILED) {
+        size_ = 0;
+        return false;
+    }
+    data_ = (const uint8_t*)p;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) munmap((void*)data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include "MappedReplayStore.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+    struct FileHeader {
+        char magic[4];      // "THRS"
+        uint32_t version;
+        uint32_t state_size;
+        uint32_t reserved;
+    };
+
+    const char store_magic[4] = { 'T', 'H', 'R', 'S' };
+    const uint32_t store_version = 1;
+
+    bool header_matches(const FileHeader& header, int state_size) {
+        return std::memcmp(header.magic, store_magic, sizeof(store_magic)) == 0 &&
+            header.version == store_version && header.state_size == (uint32_t)state_size;
+    }
+}
+
+MappedReplayStore::MappedReplayStore(const std::string& path, int state_size)
+    : path(path), state_size(state_size)
+{
+}
+
+MappedReplayStore::~MappedReplayStore() {
+    if (file) std::fclose(file);
+}
+
+// Appending is only safe behind a matching header and whole records: a torn final record
+// is cut off, and a file in another layout is replaced rather than extended
+void MappedReplayStore::open_for_append() {
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(path, ec);
+    if (ec) size = 0;
+
+    bool reuse = false;
+    if (size >= sizeof(FileHeader)) {
+        if (std::FILE* existing = std::fopen(path.c_str(), "rb")) {
+            FileHeader header;
+            reuse = std::fread(&header, sizeof(header), 1, existing) == 1 && header_matches(header, state_size);
+            std::fclose(existing);
+        }
+    }
+
+    if (reuse) {
+        uintmax_t whole = sizeof(FileHeader) + (size - sizeof(FileHeader)) / record_size() * record_size();
+        if (whole != size) {
+            std::cerr << "Dropping a torn record at the end of replay store " << path << std::endl;
+            std::filesystem::resize_file(path, whole);
+        }
+        file = std::fopen(path.c_str(), "ab");
+        if (!file) throw std::runtime_error("Cannot open replay store " + path);
+        return;
+    }
+
+    if (size > 0)
+        std::cerr << "Replay store " << path << " was written for a different state layout, starting a new one" << std::endl;
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) throw std::runtime_error("Cannot open replay store " + path);
+    FileHeader header = {};
+    std::memcpy(header.magic, store_magic, sizeof(store_magic));
+    header.version = store_version;
+    header.state_size = (uint32_t)state_size;
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1)
+        throw std::runtime_error("Writing replay store " + path + " failed");
+}
+
+void MappedReplayStore::save(TransitionBatch&& batch) {
+    if (!file) open_for_append();
+
+    // Encode the whole batch into scratch so it reaches the file in a single write
+    size_t n = batch.size();
+    size_t state_bytes = sizeof(float) * (size_t)state_size;
+    scratch.resize(n * record_size());
+    uint8_t* out = scratch.data();
+    for (size_t i = 0; i < n; ++i) {
+        RecordHeader record = {};
+        record.seq = batch.first_seq + i;
+        record.action = batch.actions[i];
+        record.reward = batch.rewards[i];
+        record.game_over = batch.done[i] ? 1u : 0u;
+        std::memcpy(out, &record, sizeof(record));
+        std::memcpy(out + sizeof(record), batch.states.data() + i * state_size, state_bytes);
+        std::memcpy(out + sizeof(record) + state_bytes, batch.next_states.data() + i * state_size, state_bytes);
+        out += record_size();
+    }
+
+    if (!scratch.empty() && std::fwrite(scratch.data(), 1, scratch.size(), file) != scratch.size())
+        throw std::runtime_error("Writing replay store " + path + " failed");
+    std::fflush(file);
+
+    if (n > 0)
+        std::cout << "Saved " << n << " new episodes to " << path << " (seq " << batch.first_seq
+            << "-" << batch.first_seq + n - 1 << ")." << std::endl;
+}
+
+void MappedReplayStore::flush() {
+    if (file) std::fflush(file);
+}
+
+uint64_t MappedReplayStore::next_seq() {
+    flush();
+
+    MappedFile mapped;
+    if (!mapped.open(path) || mapped.size() < sizeof(FileHeader)) return 0;
+
+    FileHeader header;
+    std::memcpy(&header, mapped.data(), sizeof(header));
+    size_t count = (mapped.size() - sizeof(FileHeader)) / record_size();
+    if (!header_matches(header, state_size) || count == 0) return 0;
+
+    RecordHeader last;
+    std::memcpy(&last, mapped.data() + sizeof(FileHeader) + (count - 1) * record_size(), sizeof(last));
+    return last.seq + 1;
+}
+
+int MappedReplayStore::load(ReplayBuffer& memory, int num_actions, uint64_t& next_seq) {
+    flush();
+    memory.clear();
+    next_seq = 0;
+
+    MappedFile mapped;
+    if (!mapped.open(path) || mapped.size() < sizeof(FileHeader)) return 0;
+
+    FileHeader header;
+    std::memcpy(&header, mapped.data(), sizeof(header));
+    if (!header_matches(header, state_size)) {
+        std::cerr << "Replay store " << path << " was written for a different state layout, ignoring it" << std::endl;
+        return 0;
+    }
+
+    // A torn final record from an interrupted write is ignored
+    size_t count = (mapped.size() - sizeof(FileHeader)) / record_size();
+    size_t first = count - std::min(count, (size_t)memory.capacity());
+
+    // Records are pushed straight from the mapping, no intermediate copies
+    const uint8_t* in = mapped.data() + sizeof(FileHeader) + first * record_size();
+    size_t state_bytes = sizeof(float) * (size_t)state_size;
+    for (size_t i = first; i < count; ++i, in += record_size()) {
+        RecordHeader record;
+        std::memcpy(&record, in, sizeof(record));
+        if (record.action < 0 || record.action >= num_actions) continue; // corrupt record
+        const float* state = reinterpret_cast<const float*>(in + sizeof(record));
+        const float* next = reinterpret_cast<const float*>(in + sizeof(record) + state_bytes);
+        memory.push(state, record.action, record.reward, next, record.game_over != 0);
+        next_seq = record.seq + 1;
+    }
+
+    std::cout << "Loaded " << memory.size() << " episodes from " << path << "." << std::endl;
+    return memory.size();
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <cstdio>
+#include <vector>
+#include "ReplayStore.h"
+
+// Append-only binary file of fixed-size transition records.
+// Saves append whole batches with one write; loads map the file and copy the newest
+// records straight from the mapping into the replay buffer. The first save cuts off a torn
+// final record, and replaces a file written for another layout instead of appending to it.
+class MappedReplayStore : public ReplayStore {
+public:
+    MappedReplayStore(const std::string& path, int state_size);
+    ~MappedReplayStore() override;
+
+    void save(TransitionBatch&& batch) override;
+    void flush() override;
+    uint64_t next_seq() override;
+    int load(ReplayBuffer& memory, int num_actions, uint64_t& next_seq) override;
+
+private:
+    // Record layout: seq, action, reward, game_over + padding, envstate, envstate_next
+    struct RecordHeader {
+        uint64_t seq;
+        int32_t action;
+        float reward;
+        uint32_t game_over;
+        uint32_t reserved;
+    };
+
+    void open_for_append();
+
+    size_t record_size() const { return sizeof(RecordHeader) + 2 * sizeof(float) * (size_t)state_size; }
+
+    std::string path;
+    int state_size;
+    std::FILE* file = nullptr;
+    std::vector<uint8_t> scratch; // one batch of encoded records
+};
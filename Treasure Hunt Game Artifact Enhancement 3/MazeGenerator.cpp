@@ -0,0 +1,129 @@
+#include "MazeGenerator.h"
+#include <random>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+
+namespace {
+
+    // Uniform integer in [0, n) straight from the engine; distributions differ between standard libraries
+    int draw(std::mt19937& rng, int n) {
+        return static_cast<int>(rng() % static_cast<uint32_t>(n));
+    }
+}
+
+std::vector<std::vector<float>> generate_maze(int rows, int cols, float wall_density, uint32_t seed) {
+    if (rows < 2 || cols < 2 || rows > 4096 || cols > 4096)
+        throw std::runtime_error("generate_maze: size must be between 2 and 4096");
+
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> open((size_t)rows * cols, 0);
+    auto at = [&](int r, int c) -> uint8_t& { return open[(size_t)r * cols + c]; };
+
+    // Carve from the treasure through the rooms: cells an even number of steps away from it
+    const int dr[4] = { 0, -1, 0, 1 };
+    const int dc[4] = { -1, 0, 1, 0 };
+    std::vector<std::pair<int, int>> stack;
+    stack.push_back({ rows - 1, cols - 1 });
+    at(rows - 1, cols - 1) = 1;
+    while (!stack.empty()) {
+        auto [r, c] = stack.back();
+        int options[4];
+        int n_options = 0;
+        for (int d = 0; d < 4; ++d) {
+            int nr = r + 2 * dr[d];
+            int nc = c + 2 * dc[d];
+            if (nr >= 0 && nr < rows && nc >= 0 && nc < cols && !at(nr, nc)) options[n_options++] = d;
+        }
+        if (n_options == 0) {
+            stack.pop_back();
+            continue;
+        }
+        int d = options[draw(rng, n_options)];
+        at(r + dr[d], c + dc[d]) = 1; // the wall between the two rooms
+        at(r + 2 * dr[d], c + 2 * dc[d]) = 1;
+        stack.push_back({ r + 2 * dr[d], c + 2 * dc[d] });
+    }
+
+    // Knock down walls that touch an open cell (so connectivity is kept) until the density is met
+    size_t target_walls = (size_t)(std::max(0.0f, wall_density) * open.size());
+    size_t walls = 0;
+    std::vector<int> candidates;
+    for (size_t i = 0; i < open.size(); ++i)
+        if (!open[i]) {
+            ++walls;
+            candidates.push_back((int)i);
+        }
+    for (int i = (int)candidates.size() - 1; i > 0; --i)
+        std::swap(candidates[i], candidates[draw(rng, i + 1)]);
+
+    bool progress = true;
+    while (walls > target_walls && progress) {
+        progress = false;
+        for (int& cell : candidates) {
+            if (walls <= target_walls) break;
+            if (cell < 0) continue;
+            int r = cell / cols;
+            int c = cell % cols;
+            bool touches_open = false;
+            for (int d = 0; d < 4; ++d) {
+                int nr = r + dr[d];
+                int nc = c + dc[d];
+                touches_open |= nr >= 0 && nr < rows && nc >= 0 && nc < cols && at(nr, nc);
+            }
+            if (!touches_open) continue;
+            open[cell] = 1;
+            cell = -1;
+            --walls;
+            progress = true;
+        }
+    }
+
+    std::vector<std::vector<float>> maze(rows, std::vector<float>(cols));
+    for (int r = 0; r < rows; ++r)
+        for (int c = 0; c < cols; ++c)
+            maze[r][c] = at(r, c) ? 1.0f : 0.0f;
+    return maze;
+}
+
+void save_maze(const std::string& path, const std::vector<std::vector<float>>& maze) {
+    std::ofstream out(path);
+    if (!out) throw std::runtime_error("Cannot write maze " + path);
+    out << maze.size() << " " << maze[0].size() << "\n";
+    for (const auto& row : maze) {
+        for (float v : row) out << (v > 0.0f ? '1' : '0');
+        out << "\n";
+    }
+}
+
+std::vector<std::vector<float>> load_maze(const std::string& path) {
+    std::ifstream in(path);
+    int rows = 0, cols = 0;
+    if (!(in >> rows >> cols) || rows < 1 || cols < 1)
+        throw std::runtime_error("Cannot read maze " + path);
+
+    std::vector<std::vector<float>> maze(rows, std::vector<float>(cols));
+    std::string line;
+    for (int r = 0; r < rows; ++r) {
+        if (!(in >> line) || (int)line.size() != cols)
+            throw std::runtime_error("Maze " + path + " is truncated");
+        for (int c = 0; c < cols; ++c)
+            maze[r][c] = line[c] == '1' ? 1.0f : 0.0f;
+    }
+    return maze;
+}
+
+std::vector<std::string> build_maze_corpus(const std::string& dir, const std::vector<int>& sizes,
+    int mazes_per_size, float wall_density, uint32_t seed)
+{
+    std::filesystem::create_directories(dir);
+    std::vector<std::string> paths;
+    for (int size : sizes)
+        for (int k = 0; k < mazes_per_size; ++k) {
+            std::string name = "maze_" + std::to_string(size) + "x" + std::to_string(size) + "_" + std::to_string(k) + ".txt";
+            std::string path = (std::filesystem::path(dir) / name).string();
+            save_maze(path, generate_maze(size, size, wall_density, seed + (uint32_t)k));
+            paths.push_back(path);
+        }
+    return paths;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Procedural mazes in the format TreasureMaze expects: 1 = free, 0 = wall,
+// with the treasure in the bottom-right cell.
+//
+// A recursive backtracker (iterative, explicit stack) carves a perfect maze through the cells
+// that share the treasure's row and column parity, so every open cell can reach the treasure.
+// Walls next to open cells are then knocked down at random, which adds loops, until at most
+// wall_density of the grid is wall. A perfect maze is roughly half walls, so densities above
+// that leave it unchanged.
+//
+// Only the raw std::mt19937 sequence is used, so a seed gives the same maze on every platform.
+std::vector<std::vector<float>> generate_maze(int rows, int cols, float wall_density, uint32_t seed);
+
+// Text format: a "rows cols" line, then one line of 0/1 characters per row
+void save_maze(const std::string& path, const std::vector<std::vector<float>>& maze);
+std::vector<std::vector<float>> load_maze(const std::string& path);
+
+// Write mazes_per_size square mazes for every size into dir (created if missing) as
+// maze_<size>x<size>_<k>.txt; maze k of a size uses seed + k. Returns the written paths
+std::vector<std::string> build_maze_corpus(const std::string& dir, const std::vector<int>& sizes,
+    int mazes_per_size, float wall_density, uint32_t seed);
@@ -0,0 +1,167 @@
+#include "MongoReplayStore.h"
+#include <iostream>
+#include <vector>
+
+#include <mongocxx/instance.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/uri.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/exception/exception.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/types.hpp>
+
+namespace {
+
+    // The field exists and holds a value of the given type; the get_* accessors throw otherwise
+    bool has_type(const bsoncxx::document::element& field, bsoncxx::type type) {
+        return field && field.type() == type;
+    }
+
+    // Decode a stored envstate / envstate_next field into out[n]
+    bool read_state(const bsoncxx::document::element& field, StateEncoding encoding, int n, float* out) {
+        if (!field) return false;
+        if (field.type() == bsoncxx::type::k_binary) {
+            auto bin = field.get_binary();
+            return decode_state(encoding, bin.bytes, bin.size, n, out);
+        }
+        if (field.type() == bsoncxx::type::k_array) {
+            int i = 0;
+            for (auto&& v : field.get_array().value) {
+                if (i >= n || v.type() != bsoncxx::type::k_double) return false;
+                out[i++] = static_cast<float>(v.get_double().value);
+            }
+            return i == n;
+        }
+        return false;
+    }
+
+    // The newest-seq lookup and the load range scan both sort by seq; without an index each
+    // is a full collection scan plus an in-memory sort. Creating an existing index is a no-op
+    void ensure_seq_index(mongocxx::collection& collection) {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        collection.create_index(make_document(kvp("seq", 1)));
+    }
+
+    // seq of the newest document, or -1 if the collection is empty or predates seq numbers
+    int64_t newest_seq(mongocxx::collection& collection) {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+
+        mongocxx::options::find newest;
+        newest.sort(make_document(kvp("seq", -1)));
+        newest.projection(make_document(kvp("seq", 1)));
+        auto last = collection.find_one(make_document(), newest);
+        if (!last) return -1;
+        auto field = last->view()["seq"];
+        return has_type(field, bsoncxx::type::k_int64) ? field.get_int64().value : -1;
+    }
+}
+
+MongoReplayStore::MongoReplayStore(const std::string& uri, const std::string& db_name,
+    const std::string& collection_name, StateEncoding encoding, int load_batch_size)
+    : uri(uri), db_name(db_name), collection_name(collection_name),
+    encoding(encoding), load_batch_size(load_batch_size)
+{
+    // The driver must be initialised exactly once per process
+    static mongocxx::instance mongo_instance{};
+}
+
+uint64_t MongoReplayStore::next_seq() {
+    flush();
+    try {
+        mongocxx::client client{ mongocxx::uri{ uri } };
+        auto collection = client[db_name][collection_name];
+        ensure_seq_index(collection);
+        return (uint64_t)(newest_seq(collection) + 1);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Reading the newest seq from MongoDB failed: " << e.what() << std::endl;
+        return 0;
+    }
+}
+
+void MongoReplayStore::save(TransitionBatch&& batch) {
+    if (!writer)
+        writer.reset(new MongoWriter(uri, db_name, collection_name, encoding));
+    writer->enqueue(std::move(batch));
+}
+
+void MongoReplayStore::flush() {
+    if (writer) writer->flush();
+}
+
+int MongoReplayStore::load(ReplayBuffer& memory, int num_actions, uint64_t& next_seq) {
+    using bsoncxx::builder::basic::kvp;
+    using bsoncxx::builder::basic::make_document;
+
+    flush(); // let queued inserts land before reading
+
+    int state_size = memory.state_size();
+    std::vector<float> scratch(2 * (size_t)state_size); // decode target, reused for every document
+    int64_t last_seq = -1;
+    int skipped = 0; // documents with a missing or mistyped field, or an action out of range
+
+    memory.clear();
+    try {
+        mongocxx::client client{ mongocxx::uri{ uri } };
+        auto collection = client[db_name][collection_name];
+        ensure_seq_index(collection);
+
+        // Only the newest capacity transitions fit, so start the scan there
+        auto filter = make_document();
+        int64_t newest = newest_seq(collection);
+        if (newest >= 0)
+            filter = make_document(kvp("seq", make_document(kvp("$gte", newest - memory.capacity() + 1))));
+
+        mongocxx::options::find opts;
+        opts.batch_size(load_batch_size);
+        opts.sort(make_document(kvp("seq", 1)));
+
+        // One bad document is skipped and counted rather than ending the load
+        for (auto&& doc : collection.find(filter.view(), opts)) {
+            StateEncoding doc_encoding = StateEncoding::Array;
+            auto encoding_field = doc["encoding"];
+            if (encoding_field) {
+                if (encoding_field.type() != bsoncxx::type::k_string) { ++skipped; continue; }
+                auto name = encoding_field.get_string().value;
+                if (!encoding_from_name(std::string_view(name.data(), name.size()), doc_encoding)) { ++skipped; continue; }
+            }
+
+            auto action_field = doc["action"];
+            auto reward_field = doc["reward"];
+            auto game_over_field = doc["game_over"];
+            auto seq_field = doc["seq"];
+            if (!has_type(action_field, bsoncxx::type::k_int32) ||
+                !has_type(reward_field, bsoncxx::type::k_double) ||
+                !has_type(game_over_field, bsoncxx::type::k_bool) ||
+                (seq_field && seq_field.type() != bsoncxx::type::k_int64) || // older documents have no seq
+                !read_state(doc["envstate"], doc_encoding, state_size, scratch.data()) ||
+                !read_state(doc["envstate_next"], doc_encoding, state_size, scratch.data() + state_size)) {
+                ++skipped;
+                continue;
+            }
+
+            int action = action_field.get_int32().value;
+            if (action < 0 || action >= num_actions) { ++skipped; continue; }
+
+            memory.push(scratch.data(),
+                action,
+                static_cast<float>(reward_field.get_double().value),
+                scratch.data() + state_size,
+                game_over_field.get_bool().value);
+            if (seq_field) last_seq = seq_field.get_int64().value;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Loading experience from MongoDB failed: " << e.what() << std::endl;
+    }
+
+    // Documents without a seq field leave the numbering where memory has it
+    next_seq = last_seq >= 0 ? (uint64_t)last_seq + 1 : memory.inserted();
+    std::cout << "Loaded " << memory.size() << " episodes from MongoDB";
+    if (skipped > 0) std::cout << " (skipped " << skipped << " malformed documents)";
+    std::cout << "." << std::endl;
+    return memory.size();
+}
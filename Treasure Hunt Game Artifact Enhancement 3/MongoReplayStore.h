@@ -0,0 +1,32 @@
+#pragma once
+#include <memory>
+#include <string>
+#include "ReplayStore.h"
+#include "MongoWriter.h"
+
+// Replay memory kept in a MongoDB collection, one document per transition.
+// Saves go through a background MongoWriter; loads stream the newest documents through a cursor
+// and skip, and count, documents with a missing or mistyped field.
+class MongoReplayStore : public ReplayStore {
+public:
+    MongoReplayStore(const std::string& uri = "mongodb://localhost:27017",
+        const std::string& db_name = "game_db",
+        const std::string& collection_name = "experience_buffer",
+        StateEncoding encoding = StateEncoding::Array,
+        int load_batch_size = 1000);
+
+    void save(TransitionBatch&& batch) override;
+    void flush() override;
+    uint64_t next_seq() override;
+    int load(ReplayBuffer& memory, int num_actions, uint64_t& next_seq) override;
+
+private:
+    std::string uri;
+    std::string db_name;
+    std::string collection_name;
+    StateEncoding encoding;
+    int load_batch_size;
+
+    // Started on the first save
+    std::unique_ptr<MongoWriter> writer;
+};
@@ -0,0 +1,149 @@
+#include "MongoWriter.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <mongocxx/client.hpp>
+#include <mongocxx/collection.hpp>
+#include <mongocxx/uri.hpp>
+#include <mongocxx/options/insert.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/types.hpp>
+
+namespace {
+
+    bsoncxx::types::b_binary as_binary(const std::vector<uint8_t>& bytes) {
+        return bsoncxx::types::b_binary{ bsoncxx::binary_sub_type::k_binary, (uint32_t)bytes.size(), bytes.data() };
+    }
+
+    // Build every document of the batch, then send them in one round-trip
+    void write_batch(mongocxx::collection& collection, const TransitionBatch& batch, StateEncoding encoding) {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::sub_array;
+
+        int n = batch.size();
+        int state_size = batch.state_size;
+        std::vector<bsoncxx::document::value> docs;
+        docs.reserve(n);
+
+        std::vector<uint8_t> state_bytes, next_bytes;
+
+        for (int i = 0; i < n; ++i) {
+            const float* state = batch.states.data() + (size_t)i * state_size;
+            const float* next = batch.next_states.data() + (size_t)i * state_size;
+
+            bsoncxx::builder::basic::document doc{};
+            StateEncoding doc_encoding = encoding;
+            if (doc_encoding != StateEncoding::Array) {
+                // Fall back to float32 for states the packed format cannot hold
+                state_bytes.resize(encoded_size(doc_encoding, state_size));
+                next_bytes.resize(encoded_size(doc_encoding, state_size));
+                if (!encode_state(doc_encoding, state, state_size, state_bytes.data()) ||
+                    !encode_state(doc_encoding, next, state_size, next_bytes.data())) {
+                    doc_encoding = StateEncoding::Float32;
+                    state_bytes.resize(encoded_size(doc_encoding, state_size));
+                    next_bytes.resize(encoded_size(doc_encoding, state_size));
+                    encode_state(doc_encoding, state, state_size, state_bytes.data());
+                    encode_state(doc_encoding, next, state_size, next_bytes.data());
+                }
+                doc.append(
+                    kvp("envstate", as_binary(state_bytes)),
+                    kvp("envstate_next", as_binary(next_bytes)));
+            }
+            else {
+                doc.append(
+                    kvp("envstate", [&](sub_array arr) {
+                        for (int j = 0; j < state_size; ++j) arr.append((double)state[j]);
+                    }),
+                    kvp("envstate_next", [&](sub_array arr) {
+                        for (int j = 0; j < state_size; ++j) arr.append((double)next[j]);
+                    }));
+            }
+
+            doc.append(
+                kvp("encoding", encoding_name(doc_encoding)),
+                kvp("action", batch.actions[i]),
+                kvp("reward", (double)batch.rewards[i]),
+                kvp("game_over", batch.done[i] != 0),
+                kvp("seq", (int64_t)(batch.first_seq + i)));
+            docs.push_back(doc.extract());
+        }
+
+        mongocxx::options::insert opts;
+        opts.ordered(false); // let the server apply the inserts in any order
+        collection.insert_many(docs, opts);
+    }
+}
+
+// Constructor
+MongoWriter::MongoWriter(const std::string& uri, const std::string& db_name, const std::string& collection_name,
+    StateEncoding encoding, size_t max_queued_batches)
+    : uri(uri), db_name(db_name), collection_name(collection_name), encoding(encoding),
+    max_queued_batches(max_queued_batches > 0 ? max_queued_batches : 1)
+{
+    worker = std::thread(&MongoWriter::run, this);
+}
+
+MongoWriter::~MongoWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    not_empty.notify_all();
+    worker.join();
+}
+
+void MongoWriter::enqueue(TransitionBatch&& batch) {
+    if (batch.size() == 0) return;
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        not_full.wait(lock, [this] { return queue.size() < max_queued_batches; });
+        queue.push_back(std::move(batch));
+    }
+    not_empty.notify_one();
+}
+
+void MongoWriter::flush() {
+    std::unique_lock<std::mutex> lock(mtx);
+    idle.wait(lock, [this] { return queue.empty() && !busy; });
+}
+
+void MongoWriter::run() {
+    // The client is only ever used from this thread. It is created inside the try below, so a bad
+    // URI or an unreachable server costs the batch being written, not the worker
+    std::unique_ptr<mongocxx::client> client;
+
+    while (true) {
+        TransitionBatch batch;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            not_empty.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return; // stopping with nothing left to write
+            batch = std::move(queue.front());
+            queue.pop_front();
+            busy = true;
+        }
+        not_full.notify_one();
+
+        try {
+            if (!client) client = std::make_unique<mongocxx::client>(mongocxx::uri{ uri });
+            auto collection = (*client)[db_name][collection_name];
+            write_batch(collection, batch, encoding);
+            std::cout << "Saved " << batch.size() << " new episodes to MongoDB (seq "
+                << batch.first_seq << "-" << batch.first_seq + batch.size() - 1 << ")." << std::endl;
+        }
+        catch (const std::exception& e) {
+            // Dropped for good; anything that escaped would terminate the process
+            std::cerr << "MongoDB write failed, dropped " << batch.size() << " episodes (seq "
+                << batch.first_seq << "-" << batch.first_seq + batch.size() - 1 << "): " << e.what() << std::endl;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            busy = false;
+        }
+        idle.notify_all();
+    }
+}
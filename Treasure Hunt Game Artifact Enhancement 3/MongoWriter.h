@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "ReplayBuffer.h"
+#include "StateCodec.h"
+
+// Persists transition batches to MongoDB on a background thread.
+// Batches wait in a bounded queue; the worker turns each one into BSON documents
+// (tagged with their insertion sequence number "seq") and writes them with a single
+// unordered insert_many. States are stored as arrays or as binary blobs, see StateEncoding.
+class MongoWriter {
+public:
+    MongoWriter(const std::string& uri, const std::string& db_name, const std::string& collection_name,
+        StateEncoding encoding = StateEncoding::Array, size_t max_queued_batches = 4);
+
+    // Writes everything still queued before returning
+    ~MongoWriter();
+
+    MongoWriter(const MongoWriter&) = delete;
+    MongoWriter& operator=(const MongoWriter&) = delete;
+
+    // Hand a batch to the writer; only blocks if max_queued_batches are already waiting
+    void enqueue(TransitionBatch&& batch);
+
+    // Block until every queued batch has been written
+    void flush();
+
+private:
+    void run();
+
+    std::string uri;
+    std::string db_name;
+    std::string collection_name;
+    StateEncoding encoding;
+    size_t max_queued_batches;
+
+    std::deque<TransitionBatch> queue;
+    bool busy = false;
+    bool stopping = false;
+    std::mutex mtx;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::condition_variable idle;
+
+    std::thread worker;
+};
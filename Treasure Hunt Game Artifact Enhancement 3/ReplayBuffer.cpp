@@ -0,0 +1,78 @@
+#include "ReplayBuffer.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Constructor
+ReplayBuffer::ReplayBuffer(int capacity, int state_size)
+    : capacity_(capacity), state_size_(state_size), frame_capacity(2 * capacity)
+{
+    if (capacity <= 0 || state_size <= 0)
+        throw std::runtime_error("ReplayBuffer: capacity and state size must be positive");
+
+    frames.assign((size_t)frame_capacity * state_size_, 0.0f);
+    state_frame.assign(capacity_, 0);
+    next_frame.assign(capacity_, 0);
+    actions.assign(capacity_, 0);
+    rewards.assign(capacity_, 0.0f);
+    done.assign(capacity_, 0);
+}
+
+void ReplayBuffer::clear() {
+    count = 0;
+    head = 0;
+    frame_head = 0;
+    last_next_frame = -1;
+    total = 0;
+}
+
+// Copy a state into the next free frame
+int ReplayBuffer::store_frame(const float* state) {
+    int f = frame_head;
+    std::memcpy(frames.data() + (size_t)f * state_size_, state, sizeof(float) * state_size_);
+    frame_head = (frame_head + 1) % frame_capacity;
+    return f;
+}
+
+int ReplayBuffer::push(const float* envstate, int action, float reward, const float* envstate_next, bool game_over) {
+    int slot = head;
+
+    // Consecutive steps of one game share the observation between them
+    bool shared = last_next_frame >= 0 &&
+        std::memcmp(envstate, frames.data() + (size_t)last_next_frame * state_size_, sizeof(float) * state_size_) == 0;
+
+    state_frame[slot] = shared ? last_next_frame : store_frame(envstate);
+    next_frame[slot] = store_frame(envstate_next);
+    actions[slot] = action;
+    rewards[slot] = reward;
+    done[slot] = game_over ? 1 : 0;
+    last_next_frame = next_frame[slot];
+
+    head = (head + 1) % capacity_;
+    count = std::min(count + 1, capacity_);
+    ++total;
+    return slot;
+}
+
+void ReplayBuffer::copy_since(uint64_t from_seq, TransitionBatch& out) const {
+    uint64_t oldest = total - count;
+    uint64_t first = std::max(from_seq, oldest);
+    int n = first < total ? (int)(total - first) : 0;
+
+    out.state_size = state_size_;
+    out.first_seq = first;
+    out.states.resize((size_t)n * state_size_);
+    out.next_states.resize((size_t)n * state_size_);
+    out.actions.resize(n);
+    out.rewards.resize(n);
+    out.done.resize(n);
+
+    for (int i = 0; i < n; ++i) {
+        int slot = (int)((first + i) % capacity_);
+        std::memcpy(out.states.data() + (size_t)i * state_size_, state(slot), sizeof(float) * state_size_);
+        std::memcpy(out.next_states.data() + (size_t)i * state_size_, next_state(slot), sizeof(float) * state_size_);
+        out.actions[i] = actions[slot];
+        out.rewards[i] = rewards[slot];
+        out.done[i] = done[slot];
+    }
+}
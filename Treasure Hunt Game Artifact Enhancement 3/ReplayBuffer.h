@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Plain copy of a run of transitions, in insertion order, for handing to another thread
+struct TransitionBatch {
+    int state_size = 0;
+    uint64_t first_seq = 0;          // insertion sequence number of the first transition
+    std::vector<float> states;       // [size x state_size]
+    std::vector<float> next_states;  // [size x state_size]
+    std::vector<int> actions;
+    std::vector<float> rewards;
+    std::vector<uint8_t> done;
+
+    int size() const { return static_cast<int>(actions.size()); }
+};
+
+// Fixed-capacity ring buffer of transitions in structure-of-arrays form.
+// Observations live once in a preallocated frame ring and transitions refer to them by
+// frame index, so a state that is both one step's envstate_next and the following
+// step's envstate is only stored once. Pushing never allocates.
+class ReplayBuffer {
+public:
+    ReplayBuffer(int capacity, int state_size);
+
+    // Store a transition, overwriting the oldest one when full; returns its slot
+    int push(const float* envstate, int action, float reward, const float* envstate_next, bool game_over);
+
+    void clear();
+
+    int size() const { return count; }
+    int capacity() const { return capacity_; }
+    int state_size() const { return state_size_; }
+    bool empty() const { return count == 0; }
+
+    // Slot the next push will write
+    int next_slot() const { return head; }
+
+    // Number of transitions pushed since construction or the last clear (never wraps).
+    // Transition number seq lives in slot seq % capacity while seq >= inserted() - size()
+    uint64_t inserted() const { return total; }
+
+    // Copy every live transition with sequence number >= from_seq into out
+    void copy_since(uint64_t from_seq, TransitionBatch& out) const;
+
+    const float* state(int slot) const { return frames.data() + (size_t)state_frame[slot] * state_size_; }
+    const float* next_state(int slot) const { return frames.data() + (size_t)next_frame[slot] * state_size_; }
+    int action(int slot) const { return actions[slot]; }
+    float reward(int slot) const { return rewards[slot]; }
+    bool game_over(int slot) const { return done[slot] != 0; }
+
+private:
+    int store_frame(const float* state);
+
+    int capacity_;
+    int state_size_;
+
+    // Each push adds at most two frames, so 2 * capacity frames always cover every live transition
+    int frame_capacity;
+    std::vector<float> frames; // [frame_capacity x state_size]
+    int frame_head = 0;
+    int last_next_frame = -1;  // envstate_next frame of the latest push
+
+    std::vector<int> state_frame;
+    std::vector<int> next_frame;
+    std::vector<int> actions;
+    std::vector<float> rewards;
+    std::vector<uint8_t> done;
+
+    int count = 0;
+    int head = 0;
+    uint64_t total = 0;
+};
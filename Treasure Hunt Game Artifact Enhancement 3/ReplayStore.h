@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include "ReplayBuffer.h"
+
+// Storage backend that GameExperience persists its replay memory to.
+// Transitions carry a monotonic sequence number (batch.first_seq + i) across runs.
+class ReplayStore {
+public:
+    virtual ~ReplayStore() = default;
+
+    // Persist a batch of transitions; may return before the data reaches storage
+    virtual void save(TransitionBatch&& batch) = 0;
+
+    // Block until every saved batch has reached storage
+    virtual void flush() {}
+
+    // Sequence number the next saved transition should carry: one past the newest stored (0 if none)
+    virtual uint64_t next_seq() = 0;
+
+    // Replace memory's contents with the newest stored transitions (up to its capacity),
+    // skipping any whose action is outside [0, num_actions).
+    // Sets next_seq to the sequence number after the newest one loaded (0 if none); returns the count
+    virtual int load(ReplayBuffer& memory, int num_actions, uint64_t& next_seq) = 0;
+};
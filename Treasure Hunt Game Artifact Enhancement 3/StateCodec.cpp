@@ -0,0 +1,70 @@
+#include "StateCodec.h"
+#include <cstring>
+
+namespace {
+
+    // 2-bit codes for the three cell values of a maze observation
+    const float packed_values[3] = { 0.0f, 0.5f, 1.0f };
+
+    int packed_code(float v) {
+        for (int c = 0; c < 3; ++c)
+            if (v == packed_values[c]) return c;
+        return -1;
+    }
+}
+
+const char* encoding_name(StateEncoding encoding) {
+    switch (encoding) {
+    case StateEncoding::Float32:    return "float32";
+    case StateEncoding::Packed2Bit: return "packed2";
+    default:                        return "array";
+    }
+}
+
+bool encoding_from_name(std::string_view name, StateEncoding& encoding) {
+    if (name == "array") encoding = StateEncoding::Array;
+    else if (name == "float32") encoding = StateEncoding::Float32;
+    else if (name == "packed2") encoding = StateEncoding::Packed2Bit;
+    else return false;
+    return true;
+}
+
+size_t encoded_size(StateEncoding encoding, int n) {
+    switch (encoding) {
+    case StateEncoding::Float32:    return sizeof(float) * (size_t)n;
+    case StateEncoding::Packed2Bit: return ((size_t)n + 3) / 4;
+    default:                        return 0;
+    }
+}
+
+bool encode_state(StateEncoding encoding, const float* state, int n, uint8_t* out) {
+    if (encoding == StateEncoding::Float32) {
+        std::memcpy(out, state, sizeof(float) * (size_t)n);
+        return true;
+    }
+    if (encoding != StateEncoding::Packed2Bit) return false;
+
+    std::memset(out, 0, encoded_size(encoding, n));
+    for (int i = 0; i < n; ++i) {
+        int code = packed_code(state[i]);
+        if (code < 0) return false;
+        out[i / 4] |= (uint8_t)(code << (2 * (i % 4)));
+    }
+    return true;
+}
+
+bool decode_state(StateEncoding encoding, const uint8_t* in, size_t bytes, int n, float* out) {
+    if (encoding == StateEncoding::Array || bytes != encoded_size(encoding, n)) return false;
+
+    if (encoding == StateEncoding::Float32) {
+        std::memcpy(out, in, bytes);
+        return true;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        int code = (in[i / 4] >> (2 * (i % 4))) & 3;
+        if (code > 2) return false;
+        out[i] = packed_values[code];
+    }
+    return true;
+}
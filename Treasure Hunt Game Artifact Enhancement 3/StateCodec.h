@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// How observations are written to storage
+enum class StateEncoding {
+    Array,      // one BSON double per cell
+    Float32,    // raw little-endian float32 blob
+    Packed2Bit  // 2 bits per cell, for grids whose cells are only 0, 0.5 or 1
+};
+
+const char* encoding_name(StateEncoding encoding);
+
+// Returns false if name is not an encoding produced by encoding_name
+bool encoding_from_name(std::string_view name, StateEncoding& encoding);
+
+// Bytes needed for one state of n cells in a binary encoding (0 for Array)
+size_t encoded_size(StateEncoding encoding, int n);
+
+// Write state[n] into out[encoded_size(encoding, n)].
+// Returns false if a cell holds a value the encoding cannot represent
+bool encode_state(StateEncoding encoding, const float* state, int n, uint8_t* out);
+
+// Read a binary encoded state back into out[n]; returns false if bytes does not match n
+bool decode_state(StateEncoding encoding, const uint8_t* in, size_t bytes, int n, float* out);
@@ -0,0 +1,38 @@
+#include "SumTree.h"
+#include <stdexcept>
+
+// Constructor
+SumTree::SumTree(int capacity)
+    : capacity_(capacity), leaves(1)
+{
+    if (capacity <= 0)
+        throw std::runtime_error("SumTree: capacity must be positive");
+    while (leaves < capacity) leaves *= 2;
+    tree.assign(2 * (size_t)leaves, 0.0f);
+}
+
+void SumTree::update(int slot, float priority) {
+    int node = leaves + slot;
+    tree[node] = priority;
+
+    // Re-add children rather than applying a delta, so rounding error never accumulates
+    for (node /= 2; node >= 1; node /= 2)
+        tree[node] = tree[2 * node] + tree[2 * node + 1];
+}
+
+int SumTree::find(float prefix) const {
+    int node = 1;
+    while (node < leaves) {
+        int left = 2 * node;
+        if (prefix < tree[left] || tree[left + 1] <= 0.0f) {
+            node = left;
+        }
+        else {
+            prefix -= tree[left];
+            node = left + 1;
+        }
+    }
+
+    int slot = node - leaves;
+    return slot < capacity_ ? slot : capacity_ - 1;
+}
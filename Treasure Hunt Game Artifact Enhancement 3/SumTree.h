@@ -0,0 +1,22 @@
+#pragma once
+#include <vector>
+
+// Binary tree over slot priorities where every node holds the sum of its children.
+// Updating a slot and finding the slot that owns a prefix sum are both O(log N).
+class SumTree {
+public:
+    explicit SumTree(int capacity);
+
+    void update(int slot, float priority);
+    float priority(int slot) const { return tree[leaves + slot]; }
+    float total() const { return tree[1]; }
+    int capacity() const { return capacity_; }
+
+    // Slot whose cumulative priority range contains prefix, for 0 <= prefix < total()
+    int find(float prefix) const;
+
+private:
+    int capacity_;
+    int leaves;              // power of two >= capacity
+    std::vector<float> tree; // 1-based heap layout, leaves at [leaves, 2 * leaves)
+};
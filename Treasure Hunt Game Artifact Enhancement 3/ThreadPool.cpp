@@ -0,0 +1,72 @@
+#include "ThreadPool.h"
+
+// Constructor
+ThreadPool::ThreadPool(int num_threads) {
+    for (int i = 1; i < num_threads; ++i)
+        workers.emplace_back(&ThreadPool::worker_loop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+void ThreadPool::run(int count, const std::function<void(int)>& task) {
+    if (count <= 0) return;
+    if (workers.empty() || count == 1) {
+        for (int i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        current = &task;
+        task_count = count;
+        next_task = 0;
+        pending = count;
+        ++generation;
+    }
+    work_cv.notify_all();
+
+    drain(); // the caller works too
+
+    std::unique_lock<std::mutex> lock(mtx);
+    done_cv.wait(lock, [this] { return pending == 0; });
+    current = nullptr;
+}
+
+// Claim and run tasks of the current job until none are left
+void ThreadPool::drain() {
+    while (true) {
+        int i;
+        const std::function<void(int)>* task;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (current == nullptr || next_task >= task_count) return;
+            i = next_task++;
+            task = current;
+        }
+
+        (*task)(i);
+
+        std::lock_guard<std::mutex> lock(mtx);
+        if (--pending == 0) done_cv.notify_one();
+    }
+}
+
+void ThreadPool::worker_loop() {
+    unsigned seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            work_cv.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        drain();
+    }
+}
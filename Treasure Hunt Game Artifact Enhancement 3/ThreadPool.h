@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads that run a parallel-for and block until it finishes
+class ThreadPool {
+public:
+    // num_threads counts the calling thread, so ThreadPool(4) starts 3 workers
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+
+    // Run task(0) .. task(count - 1) across the pool and the calling thread
+    void run(int count, const std::function<void(int)>& task);
+
+private:
+    void worker_loop();
+    void drain();
+
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+
+    const std::function<void(int)>* current = nullptr;
+    int task_count = 0;
+    int next_task = 0;
+    int pending = 0;
+    unsigned generation = 0;
+    bool stopping = false;
+};
@@ -1,22 +1,60 @@
 #include "TreasureMaze.h"
 
+void MoveTable::build(const std::vector<std::vector<float>>& maze) {
+    int nrows = static_cast<int>(maze.size());
+    int ncols = static_cast<int>(maze[0].size());
+    target = nrows * ncols - 1;
+    min_reward = -0.5f * nrows * ncols;
+    mask.assign((size_t)nrows * ncols, 0);
+    neighbor.assign((size_t)nrows * ncols * 4, -1);
+
+    // Row / column offsets of LEFT, UP, RIGHT, DOWN
+    const int dr[4] = { 0, -1, 0, 1 };
+    const int dc[4] = { -1, 0, 1, 0 };
+    for (int r = 0; r < nrows; ++r)
+        for (int c = 0; c < ncols; ++c) {
+            int cell = r * ncols + c;
+            for (int a = 0; a < 4; ++a) {
+                int nr = r + dr[a];
+                int nc = c + dc[a];
+                if (nr < 0 || nr >= nrows || nc < 0 || nc >= ncols || maze[nr][nc] == 0.0f) continue;
+                mask[cell] |= (uint8_t)(1 << a);
+                neighbor[cell * 4 + a] = nr * ncols + nc;
+            }
+        }
+}
+
+int best_valid_action(const float* q_values, unsigned mask) {
+    if (mask == 0) mask = 0xF;
+    int best = lowest_action(mask);
+    for (unsigned m = mask & (mask - 1); m; m &= m - 1) {
+        int action = lowest_action(m);
+        if (q_values[action] > q_values[best]) best = action;
+    }
+    return best;
+}
+
 // Constructor
 TreasureMaze::TreasureMaze(const std::vector<std::vector<float>>& maze_input, std::pair<int, int> pirate)
 {
     _maze = maze_input;
-    int nrows = _maze.size();
-    int ncols = _maze[0].size();
-    target = { nrows - 1, ncols - 1 };
+    nrows = static_cast<int>(_maze.size());
+    ncols = static_cast<int>(_maze[0].size());
+    visited.assign((nrows * ncols + 63) / 64, 0);
+    moves.build(_maze);
 
     // Find all free cells
+    open_bits.assign((nrows * ncols + 63) / 64, 0);
     for (int r = 0; r < nrows; ++r) {
         for (int c = 0; c < ncols; ++c) {
             if (_maze[r][c] == 1.0f) free_cells.push_back({ r,c });
+            if (_maze[r][c] > 0.0f) open_bits[(r * ncols + c) >> 6] |= uint64_t(1) << ((r * ncols + c) & 63);
         }
     }
-    free_cells.erase(std::remove(free_cells.begin(), free_cells.end(), target), free_cells.end());
+    free_cells.erase(std::remove(free_cells.begin(), free_cells.end(), std::make_pair(nrows - 1, ncols - 1)),
+        free_cells.end());
 
-    if (_maze[target.first][target.second] == 0.0f)
+    if (_maze[nrows - 1][ncols - 1] == 0.0f)
         throw std::runtime_error("Invalid maze: target cell cannot be blocked!");
 
     if (std::find(free_cells.begin(), free_cells.end(), pirate) == free_cells.end())
@@ -25,75 +63,52 @@ TreasureMaze::TreasureMaze(const std::vector<std::vector<float>>& maze_input, st
     reset(pirate);
 }
 
-// Reset method
+// Reset method; O(cells / 64) and allocation-free
 void TreasureMaze::reset(std::pair<int, int> pirate) {
-    this->maze = _maze;
-    this->state = { pirate.first, pirate.second, "start" };
-    maze[pirate.first][pirate.second] = pirate_mark;
-    min_reward = -0.5f * maze.size() * maze[0].size();
+    pirate_row = pirate.first;
+    pirate_col = pirate.second;
+    mode = PirateMode::Start;
     total_reward = 0;
-    visited.clear();
+    std::fill(visited.begin(), visited.end(), 0);
 }
 
 // Update pirate position
 void TreasureMaze::update_state(int action) {
-    int pirate_row = std::get<0>(state);
-    int pirate_col = std::get<1>(state);
-    std::string mode = std::get<2>(state);
-
-    if (maze[pirate_row][pirate_col] > 0.0f)
-        visited.insert({ pirate_row, pirate_col });
-
-    std::vector<int> valid = valid_actions();
-
-    std::string new_mode = mode;
-
-    int nrow = pirate_row;
-    int ncol = pirate_col;
-
-    if (valid.empty()) {
-        new_mode = "blocked";
-    }
-    else if (std::find(valid.begin(), valid.end(), action) != valid.end()) {
-        new_mode = "valid";
-        switch (action) {
-        case LEFT:  ncol -= 1; break;
-        case UP:    nrow -= 1; break;
-        case RIGHT: ncol += 1; break;
-        case DOWN:  nrow += 1; break;
-        }
-    }
-    else {
-        new_mode = "invalid";
-    }
-
-    state = { nrow, ncol, new_mode };
+    int next = moves.move(pirate_row * ncols + pirate_col, action, visited.data(), mode);
+    pirate_row = next / ncols;
+    pirate_col = next % ncols;
 }
 
 // Get reward for current state
 float TreasureMaze::get_reward() {
-    int pirate_row = std::get<0>(state);
-    int pirate_col = std::get<1>(state);
-    std::string mode = std::get<2>(state);
-    int nrows = maze.size();
-    int ncols = maze[0].size();
-
-    if (pirate_row == nrows - 1 && pirate_col == ncols - 1) return 1.0f;
-    if (mode == "blocked") return min_reward - 1;
-    if (visited.find({ pirate_row, pirate_col }) != visited.end()) return -0.25f;
-    if (mode == "invalid") return -0.75f;
-    if (mode == "valid") return -0.04f;
-    return 0.0f;
+    return moves.reward(pirate_row * ncols + pirate_col, mode, visited.data());
 }
 
 // Act: move pirate and get environment feedback
-std::tuple<std::vector<std::vector<float>>, float, std::string> TreasureMaze::act(int action) {
+std::tuple<std::vector<std::vector<float>>, float, GameStatus> TreasureMaze::act(int action) {
     update_state(action);
     float reward = get_reward();
     total_reward += reward;
-    std::string status = game_status();
-    std::vector<std::vector<float>> envstate = observe();
-    return { envstate, reward, status };
+    return { observe(), reward, game_status() };
+}
+
+GameStatus TreasureMaze::step(int action, float* obs, float& reward) {
+    int from = pirate_row * ncols + pirate_col;
+
+    update_state(action);
+    reward = get_reward();
+    total_reward += reward;
+
+    obs[from] = 1.0f;
+    obs[pirate_row * ncols + pirate_col] = pirate_mark;
+    return game_status();
+}
+
+void TreasureMaze::observe_into(float* obs) const {
+    for (int r = 0; r < nrows; ++r)
+        for (int c = 0; c < ncols; ++c)
+            obs[r * ncols + c] = _maze[r][c] > 0.0f ? 1.0f : 0.0f;
+    obs[pirate_row * ncols + pirate_col] = pirate_mark;
 }
 
 // Return current environment
@@ -103,63 +118,25 @@ std::vector<std::vector<float>> TreasureMaze::observe() {
 
 // Draw maze for visualization
 std::vector<std::vector<float>> TreasureMaze::draw_env() {
-    std::vector<std::vector<float>> canvas = maze;
-    int nrows = canvas.size();
-    int ncols = canvas[0].size();
-
-    // Clear marks
-    for (int r = 0; r < nrows; ++r) {
-        for (int c = 0; c < ncols; ++c) {
-            if (canvas[r][c] > 0.0f) canvas[r][c] = 1.0f;
-        }
-    }
-
-    int row = std::get<0>(state);
-    int col = std::get<1>(state);
-    canvas[row][col] = pirate_mark;
-
+    std::vector<std::vector<float>> canvas(nrows, std::vector<float>(ncols));
+    for (int r = 0; r < nrows; ++r)
+        for (int c = 0; c < ncols; ++c)
+            canvas[r][c] = _maze[r][c] > 0.0f ? 1.0f : 0.0f;
+    canvas[pirate_row][pirate_col] = pirate_mark;
     return canvas;
 }
 
 // Return game status
-std::string TreasureMaze::game_status() {
-    if (total_reward < min_reward) return "lose";
-
-    int pirate_row = std::get<0>(state);
-    int pirate_col = std::get<1>(state);
-    int nrows = maze.size();
-    int ncols = maze[0].size();
-
-    if (pirate_row == nrows - 1 && pirate_col == ncols - 1) return "win";
-
-    return "not_over";
+GameStatus TreasureMaze::game_status() const {
+    return moves.status(pirate_row * ncols + pirate_col, total_reward);
 }
 
-// Return list of valid actions
-std::vector<int> TreasureMaze::valid_actions(std::pair<int, int> cell) {
-    int row, col;
-    if (cell.first == -1) {
-        row = std::get<0>(state);
-        col = std::get<1>(state);
-    }
-    else {
-        row = cell.first;
-        col = cell.second;
-    }
-
-    std::vector<int> actions = { LEFT, UP, RIGHT, DOWN };
-    int nrows = maze.size();
-    int ncols = maze[0].size();
-
-    if (row == 0) actions.erase(std::remove(actions.begin(), actions.end(), UP), actions.end());
-    if (row == nrows - 1) actions.erase(std::remove(actions.begin(), actions.end(), DOWN), actions.end());
-    if (col == 0) actions.erase(std::remove(actions.begin(), actions.end(), LEFT), actions.end());
-    if (col == ncols - 1) actions.erase(std::remove(actions.begin(), actions.end(), RIGHT), actions.end());
-
-    if (row > 0 && maze[row - 1][col] == 0.0f) actions.erase(std::remove(actions.begin(), actions.end(), UP), actions.end());
-    if (row < nrows - 1 && maze[row + 1][col] == 0.0f) actions.erase(std::remove(actions.begin(), actions.end(), DOWN), actions.end());
-    if (col > 0 && maze[row][col - 1] == 0.0f) actions.erase(std::remove(actions.begin(), actions.end(), LEFT), actions.end());
-    if (col < ncols - 1 && maze[row][col + 1] == 0.0f) actions.erase(std::remove(actions.begin(), actions.end(), RIGHT), actions.end());
+// Return list of valid actions, read off the precomputed move mask
+ValidActions TreasureMaze::valid_actions(std::pair<int, int> cell) const {
+    int index = cell.first == -1 ? pirate_row * ncols + pirate_col : cell.first * ncols + cell.second;
 
-    return actions;
+    ValidActions valid;
+    for (unsigned m = moves.mask[index]; m; m &= m - 1)
+        valid.actions[valid.count++] = lowest_action(m);
+    return valid;
 }
@@ -1,8 +1,9 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <tuple>
-#include <set>
+#include <cstdint>
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
@@ -16,6 +17,78 @@ const int UP = 1;
 const int RIGHT = 2;
 const int DOWN = 3;
 
+// Outcome of the game after a step
+enum class GameStatus { NotOver, Win, Lose };
+
+// What the last move did
+enum class PirateMode : uint8_t { Start, Valid, Invalid, Blocked };
+
+// Move tables of a maze layout, built once because the walls never change.
+// mask[cell] has bit a set when action a leads to an open cell;
+// neighbor[cell * 4 + a] is the cell it leads to, or -1 when that move is not valid.
+// The game rules live here too, so TreasureMaze and VectorMaze cannot drift apart
+struct MoveTable {
+    std::vector<uint8_t> mask;
+    std::vector<int> neighbor;
+    int target = 0;         // cell of the treasure (bottom-right corner)
+    float min_reward = 0;   // a game is lost once its total reward drops below this
+
+    void build(const std::vector<std::vector<float>>& maze);
+
+    // Take action from cell: marks cell in the game's visited bitboard, sets mode and
+    // returns the pirate's new cell
+    int move(int cell, int action, uint64_t* visited, PirateMode& mode) const {
+        visited[cell >> 6] |= uint64_t(1) << (cell & 63);
+        unsigned m = mask[cell];
+        if (m == 0) {
+            mode = PirateMode::Blocked;
+            return cell;
+        }
+        if (action >= 0 && action < 4 && ((m >> action) & 1)) {
+            mode = PirateMode::Valid;
+            return neighbor[cell * 4 + action];
+        }
+        mode = PirateMode::Invalid;
+        return cell;
+    }
+
+    // Reward for standing on cell after a move that ended in mode
+    float reward(int cell, PirateMode mode, const uint64_t* visited) const {
+        if (cell == target) return 1.0f;
+        if (mode == PirateMode::Blocked) return min_reward - 1;
+        if ((visited[cell >> 6] >> (cell & 63)) & 1) return -0.25f;
+        if (mode == PirateMode::Invalid) return -0.75f;
+        if (mode == PirateMode::Valid) return -0.04f;
+        return 0.0f;
+    }
+
+    GameStatus status(int cell, float total_reward) const {
+        if (total_reward < min_reward) return GameStatus::Lose;
+        if (cell == target) return GameStatus::Win;
+        return GameStatus::NotOver;
+    }
+};
+
+// Allocation-free iteration over a move mask:
+//     for (unsigned m = mask; m; m &= m - 1) { int action = lowest_action(m); ... }
+inline int lowest_action(unsigned mask) {
+    return (mask & 1) ? LEFT : (mask & 2) ? UP : (mask & 4) ? RIGHT : DOWN;
+}
+
+// The valid actions of one cell in increasing order, held inline so listing them never allocates
+struct ValidActions {
+    std::array<int, 4> actions{};
+    int count = 0;
+
+    int size() const { return count; }
+    int operator[](int i) const { return actions[i]; }
+    const int* begin() const { return actions.data(); }
+    const int* end() const { return actions.data() + count; }
+};
+
+// Greedy action over q_values[4] restricted to the moves in mask (all four when mask is empty)
+int best_valid_action(const float* q_values, unsigned mask);
+
 class TreasureMaze {
 public:
     TreasureMaze(const std::vector<std::vector<float>>& maze, std::pair<int, int> pirate = { 0,0 });
@@ -23,19 +96,42 @@ public:
     void reset(std::pair<int, int> pirate);
     void update_state(int action);
     float get_reward();
-    std::tuple<std::vector<std::vector<float>>, float, std::string> act(int action);
+    std::tuple<std::vector<std::vector<float>>, float, GameStatus> act(int action);
     std::vector<std::vector<float>> observe();
     std::vector<std::vector<float>> draw_env();
-    std::string game_status();
-    std::vector<int> valid_actions(std::pair<int, int> cell = { -1,-1 });
+    GameStatus game_status() const;
+
+    // Write the flattened observation [rows x cols] into obs
+    void observe_into(float* obs) const;
+
+    // Allocation-free act: obs must hold the current observation (from observe_into or the
+    // previous step) and is updated in place; only the cells the pirate left and entered change
+    GameStatus step(int action, float* obs, float& reward);
+
+    int cells() const { return nrows * ncols; }
+    ValidActions valid_actions(std::pair<int, int> cell = { -1,-1 }) const;
+
+    // Bit-packed observation: bit i of free_bits() is set on open cells, the pirate stands on
+    // pirate_cell(); see DQN::predict_sparse_batch
+    const uint64_t* free_bits() const { return open_bits.data(); }
+    int pirate_cell() const { return pirate_row * ncols + pirate_col; }
+
+    // Valid moves from the pirate's cell as a bit mask (bit a = action a)
+    unsigned valid_move_mask() const { return moves.mask[pirate_row * ncols + pirate_col]; }
     std::vector<std::pair<int, int>> free_cells;
 
 private:
     std::vector<std::vector<float>> _maze;
-    std::vector<std::vector<float>> maze;
-    std::pair<int, int> target;
-    std::tuple<int, int, std::string> state; // (row, col, mode)
-    float min_reward;
+    int nrows;
+    int ncols;
+    MoveTable moves; // also holds the treasure cell and the losing threshold
+    std::vector<uint64_t> open_bits; // bitset of the cells that are not walls
+
+    int pirate_row;
+    int pirate_col;
+    PirateMode mode;
     float total_reward;
-    std::set<std::pair<int, int>> visited;
+
+    // One bit per cell index, set once the pirate has stood there
+    std::vector<uint64_t> visited;
 };
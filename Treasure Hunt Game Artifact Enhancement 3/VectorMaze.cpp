@@ -0,0 +1,71 @@
+#include "VectorMaze.h"
+#include <stdexcept>
+
+VectorMaze::VectorMaze(const std::vector<std::vector<float>>& maze, int num_envs)
+    : nrows((int)maze.size()), ncols((int)maze[0].size()), num_cells(nrows * ncols), num_envs(num_envs),
+    visited_words((num_cells + 63) / 64)
+{
+    if (num_envs < 1) throw std::runtime_error("VectorMaze needs at least one environment");
+
+    moves.build(maze);
+    int target = moves.target;
+    walls.resize(num_cells);
+    open_bits.assign((num_cells + 63) / 64, 0);
+    for (int r = 0; r < nrows; ++r)
+        for (int c = 0; c < ncols; ++c) {
+            int cell = r * ncols + c;
+            walls[cell] = maze[r][c] == 0.0f;
+            if (!walls[cell]) open_bits[cell >> 6] |= uint64_t(1) << (cell & 63);
+            if (maze[r][c] == 1.0f && cell != target) free_cells.push_back({ r,c });
+        }
+    if (walls[target])
+        throw std::runtime_error("Invalid maze: target cell cannot be blocked!");
+    if (free_cells.empty())
+        throw std::invalid_argument("Invalid maze: no free cell to start a game on");
+
+    pirate.assign(num_envs, 0);
+    mode.assign(num_envs, PirateMode::Start);
+    total_reward.assign(num_envs, 0.0f);
+    rewards.assign(num_envs, 0.0f);
+    statuses.assign(num_envs, GameStatus::NotOver);
+    visited.assign((size_t)num_envs * visited_words, 0);
+    obs.resize((size_t)num_envs * num_cells);
+
+    for (int e = 0; e < num_envs; ++e)
+        reset(e, free_cells.front());
+}
+
+void VectorMaze::reset(int env, std::pair<int, int> start) {
+    int cell = start.first * ncols + start.second;
+    if (cell < 0 || cell >= num_cells || walls[cell] || cell == moves.target)
+        throw std::runtime_error("Invalid Pirate Location: must sit on a free cell");
+
+    pirate[env] = cell;
+    mode[env] = PirateMode::Start;
+    total_reward[env] = 0.0f;
+    rewards[env] = 0.0f;
+    statuses[env] = GameStatus::NotOver;
+    std::fill(visited.begin() + (size_t)env * visited_words, visited.begin() + (size_t)(env + 1) * visited_words, 0);
+
+    float* o = obs.data() + (size_t)env * num_cells;
+    for (int i = 0; i < num_cells; ++i) o[i] = walls[i] ? 0.0f : 1.0f;
+    o[cell] = pirate_mark;
+}
+
+void VectorMaze::act(const int* actions) {
+    for (int e = 0; e < num_envs; ++e) {
+        int cell = pirate[e];
+        uint64_t* seen = visited.data() + (size_t)e * visited_words;
+        int moved = moves.move(cell, actions[e], seen, mode[e]);
+
+        rewards[e] = moves.reward(moved, mode[e], seen);
+        total_reward[e] += rewards[e];
+        statuses[e] = moves.status(moved, total_reward[e]);
+
+        // Only the two cells the pirate left and entered change
+        float* o = obs.data() + (size_t)e * num_cells;
+        o[cell] = 1.0f;
+        o[moved] = pirate_mark;
+        pirate[e] = moved;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "TreasureMaze.h"
+
+// N independent games on the same maze layout, stepped together.
+// Per-game state is kept in structure-of-arrays form and the observations of all games
+// form one contiguous [N x cells] matrix, ready to be fed to DQN::predict_batch as is.
+// Rewards and rules match TreasureMaze.
+class VectorMaze {
+public:
+    VectorMaze(const std::vector<std::vector<float>>& maze, int num_envs);
+
+    // Start game env over with the pirate on a free cell
+    void reset(int env, std::pair<int, int> pirate);
+
+    // Advance every game by one move; actions[num_envs].
+    // Finished games must be reset before they are stepped again
+    void act(const int* actions);
+
+    // [num_envs x cells] observations after the last act / reset
+    const float* observations() const { return obs.data(); }
+    const float* observation(int env) const { return obs.data() + (size_t)env * num_cells; }
+
+    // Bit-packed form of the observations: bit i of free_bits() is set on open cells (shared by all
+    // games) and game env's pirate stands on pirate_cells()[env]; see DQN::predict_sparse_batch
+    const uint64_t* free_bits() const { return open_bits.data(); }
+    const int* pirate_cells() const { return pirate.data(); }
+
+    // Per-game results of the last act
+    float reward(int env) const { return rewards[env]; }
+    GameStatus status(int env) const { return statuses[env]; }
+
+    // Valid moves of game env as a bit mask (bit a = action a), see MoveTable
+    unsigned valid_moves(int env) const { return moves.mask[pirate[env]]; }
+
+    int size() const { return num_envs; }
+    int cells() const { return num_cells; }
+
+    std::vector<std::pair<int, int>> free_cells;
+
+private:
+    int nrows;
+    int ncols;
+    int num_cells;
+    int num_envs;
+    std::vector<uint8_t> walls;  // [cells], 1 where blocked
+    std::vector<uint64_t> open_bits; // bitset of the cells that are not walls
+    MoveTable moves;             // also holds the treasure cell and the game rules
+
+    // Per-game state, one entry per environment
+    std::vector<int> pirate;     // cell index
+    std::vector<PirateMode> mode;
+    std::vector<float> total_reward;
+    std::vector<float> rewards;
+    std::vector<GameStatus> statuses;
+    int visited_words;            // 64-bit words per game in visited
+    std::vector<uint64_t> visited; // [num_envs x visited_words] bitboards indexed by cell
+    std::vector<float> obs;       // [num_envs x cells]
+};
@@ -0,0 +1,335 @@
+// Microbenchmarks for the environment, replay memory and network.
+//
+//     Benchmark [filter] [corpus_dir] [--env-sizes LIST] [--sizes LIST] [--batches LIST]
+//               [--layouts LIST] [--min-time SECONDS | --iterations N]
+//
+// Runs every benchmark whose name contains filter and prints, per operation, the time,
+// the heap allocations and the throughput. Each benchmark repeats its operation until
+// at least min_seconds have passed, after a short warm-up; --iterations runs it exactly N times instead.
+//
+// LISTs are comma separated: --env-sizes sets the maze sizes of the environment benchmarks,
+// --sizes those of the replay and network ones, --batches the batch sizes of both and
+// --layouts the hidden layers of the network, e.g. --layouts 64x32x16x8x4,256x256.
+//
+// With corpus_dir (written by treasure_hunt --build-corpus) every size runs on the corpus
+// maze maze_<size>x<size>_0.txt, so results compare across machines and with training runs
+// on the same files; without it the mazes are generated with a fixed seed.
+//
+// Links against the trainer's sources except main.cpp and the MongoDB store, so it
+// needs no database driver.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "../DQN.h"
+#include "../GameExperience.h"
+#include "../Kernels.h"
+#include "../MazeGenerator.h"
+#include "../TreasureMaze.h"
+#include "../VectorMaze.h"
+
+// ----------------- Allocation counting -----------------
+
+static std::atomic<long long> allocation_count{ 0 };
+
+void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+// ----------------- Harness -----------------
+
+namespace {
+
+    double min_seconds = 0.25;
+    long long fixed_iterations = 0; // > 0: run each op exactly this often instead of timing to min_seconds
+
+    // Keeps results alive so the optimizer cannot drop the measured work
+    volatile float sink;
+
+    std::string filter;
+    std::string corpus_dir;
+
+    // op runs the measured operation once; items is how many samples / steps one op processes
+    void run(const std::string& name, double items, const std::function<void()>& op) {
+        if (name.find(filter) == std::string::npos) return;
+
+        for (int i = 0; i < 3; ++i) op(); // warm-up, fills lazily sized buffers
+
+        using clock = std::chrono::steady_clock;
+        long long iterations = fixed_iterations > 0 ? fixed_iterations : 1;
+        double seconds = 0;
+        long long allocations = 0;
+        while (true) {
+            long long allocs_before = allocation_count.load();
+            auto start = clock::now();
+            for (long long i = 0; i < iterations; ++i) op();
+            seconds = std::chrono::duration<double>(clock::now() - start).count();
+            allocations = allocation_count.load() - allocs_before;
+            if (fixed_iterations > 0 || seconds >= min_seconds) break;
+            iterations *= seconds > 0.01 ? std::max(2LL, (long long)(min_seconds / seconds * 1.2)) : 10;
+        }
+
+        double ns_per_op = seconds * 1e9 / iterations;
+        double rate = items * iterations / seconds;
+        const char* unit = "";
+        if (rate >= 1e9) { rate /= 1e9; unit = "G"; }
+        else if (rate >= 1e6) { rate /= 1e6; unit = "M"; }
+        else if (rate >= 1e3) { rate /= 1e3; unit = "k"; }
+        std::printf("%-56s %14.1f %12.2f %10.2f%s items/s %12lld\n", name.c_str(), ns_per_op,
+            (double)allocations / iterations, rate, unit, iterations);
+    }
+
+    // "8,32,128" -> { 8, 32, 128 }; false on anything but positive integers split by sep
+    bool parse_list(const std::string& text, char sep, std::vector<int>& out) {
+        out.clear();
+        size_t pos = 0;
+        while (pos <= text.size()) {
+            size_t end = text.find(sep, pos);
+            if (end == std::string::npos) end = text.size();
+            std::string item = text.substr(pos, end - pos);
+            char* rest = nullptr;
+            long value = std::strtol(item.c_str(), &rest, 10);
+            if (item.empty() || *rest != '\0' || value <= 0) return false;
+            out.push_back((int)value);
+            pos = end + 1;
+        }
+        return true;
+    }
+
+    std::string layout_name(const std::vector<int>& hidden) {
+        std::string s;
+        for (int h : hidden) s += (s.empty() ? "" : "x") + std::to_string(h);
+        return s;
+    }
+
+    std::vector<std::vector<float>> bench_maze(int size) {
+        if (corpus_dir.empty()) return generate_maze(size, size, 0.3f, 7);
+        std::string name = "maze_" + std::to_string(size) + "x" + std::to_string(size) + "_0.txt";
+        return load_maze(corpus_dir + "/" + name);
+    }
+
+    // First open cell other than the treasure; generated mazes may wall off (0, 0)
+    std::pair<int, int> first_free_cell(const std::vector<std::vector<float>>& grid) {
+        for (int r = 0; r < (int)grid.size(); ++r)
+            for (int c = 0; c < (int)grid[r].size(); ++c)
+                if (grid[r][c] == 1.0f) return { r, c };
+        return { 0, 0 };
+    }
+
+    std::pair<int, int> start_cell(const std::vector<std::pair<int, int>>& free_cells, std::mt19937& rng) {
+        return free_cells[rng() % free_cells.size()];
+    }
+}
+
+// ----------------- Environment -----------------
+
+void bench_environment(const std::vector<int>& sizes) {
+    for (int size : sizes) {
+        auto grid = bench_maze(size);
+        std::string suffix = "/" + std::to_string(size);
+        std::mt19937 rng(1);
+
+        TreasureMaze maze(grid, first_free_cell(grid));
+        maze.reset(start_cell(maze.free_cells, rng));
+        run("TreasureMaze::act" + suffix, 1, [&] {
+            auto [env, reward, status] = maze.act(rng() & 3);
+            sink = reward;
+            if (status != GameStatus::NotOver) maze.reset(start_cell(maze.free_cells, rng));
+        });
+
+        std::vector<float> obs(maze.cells());
+        maze.reset(start_cell(maze.free_cells, rng));
+        maze.observe_into(obs.data());
+        run("TreasureMaze::step" + suffix, 1, [&] {
+            float reward;
+            if (maze.step(rng() & 3, obs.data(), reward) != GameStatus::NotOver) {
+                maze.reset(start_cell(maze.free_cells, rng));
+                maze.observe_into(obs.data());
+            }
+            sink = reward;
+        });
+
+        run("TreasureMaze::valid_actions" + suffix, 1, [&] {
+            sink = (float)maze.valid_actions().size();
+        });
+
+        run("TreasureMaze::valid_move_mask" + suffix, 1, [&] {
+            unsigned count = 0;
+            for (unsigned m = maze.valid_move_mask(); m; m &= m - 1) ++count;
+            sink = (float)count;
+        });
+
+        const int num_envs = 8;
+        VectorMaze envs(grid, num_envs);
+        for (int e = 0; e < num_envs; ++e) envs.reset(e, start_cell(envs.free_cells, rng));
+        std::vector<int> actions(num_envs);
+        run("VectorMaze::act" + suffix + "/envs:8", num_envs, [&] {
+            for (int& a : actions) a = rng() & 3;
+            envs.act(actions.data());
+            for (int e = 0; e < num_envs; ++e)
+                if (envs.status(e) != GameStatus::NotOver) envs.reset(e, start_cell(envs.free_cells, rng));
+            sink = envs.reward(0);
+        });
+    }
+}
+
+// ----------------- Replay memory -----------------
+
+void bench_replay(const std::vector<int>& sizes, const std::vector<int>& batches) {
+    for (int size : sizes) {
+        int cells = size * size;
+        std::vector<float> state(cells, 1.0f), next(cells, 1.0f);
+        std::string suffix = "/" + std::to_string(size);
+
+        GameExperience experience(cells, 4, 1000, 0.95f, { 64, 32 }, 0.001f, 1);
+        int step = 0;
+        run("GameExperience::remember" + suffix, 1, [&] {
+            state[step % cells] = 0.5f;
+            next[(step + 1) % cells] = 0.5f;
+            experience.remember({ state.data(), step & 3, -0.04f, next.data(), (step % 50) == 49 });
+            state[step % cells] = 1.0f;
+            next[(step + 1) % cells] = 1.0f;
+            ++step;
+        });
+
+        std::vector<float> inputs, targets;
+        for (int batch : batches)
+            run("GameExperience::get_data" + suffix + "/batch:" + std::to_string(batch), batch, [&] {
+                sink = (float)experience.get_data(inputs, targets, batch);
+            });
+    }
+}
+
+// ----------------- Network -----------------
+
+void bench_network(const std::vector<int>& sizes, const std::vector<int>& batches,
+    const std::vector<std::vector<int>>& layouts)
+{
+    std::mt19937 rng(3);
+    for (int size : sizes) {
+        auto grid = bench_maze(size);
+        int cells = size * size;
+        for (const auto& hidden : layouts) {
+            std::string suffix = "/" + std::to_string(size) + "/" + layout_name(hidden);
+            DQN model(cells, hidden, 4, 0.001f);
+            model.set_optimizer(Optimizer::Adam);
+
+            VectorMaze envs(grid, std::max(1, *std::max_element(batches.begin(), batches.end())));
+            for (int e = 0; e < envs.size(); ++e) envs.reset(e, start_cell(envs.free_cells, rng));
+
+            std::vector<float> state(envs.observation(0), envs.observation(0) + cells);
+            std::vector<float> q(4);
+            run("DQN::predict" + suffix, 1, [&] {
+                model.predict_into(state.data(), q.data());
+                sink = q[0];
+            });
+
+            for (int batch : batches) {
+                std::string b = "/batch:" + std::to_string(batch);
+                std::vector<float> q_batch((size_t)batch * 4);
+                run("DQN::predict_batch" + suffix + b, batch, [&] {
+                    sink = model.predict_batch(envs.observations(), batch)[0];
+                });
+                run("DQN::predict_sparse_batch" + suffix + b, batch, [&] {
+                    model.predict_sparse_batch(envs.free_bits(), envs.pirate_cells(), pirate_mark, batch, q_batch.data());
+                    sink = q_batch[0];
+                });
+
+                std::vector<float> targets((size_t)batch * 4, 0.0f);
+                run("DQN::fit" + suffix + b, batch, [&] {
+                    model.fit(envs.observations(), targets.data(), batch);
+                });
+
+                // The trainer's step: every prediction follows a weight update, so the sparse
+                // path rebuilds its free-cell sum each time instead of reusing it
+                run("DQN::predict_batch+fit" + suffix + b, batch, [&] {
+                    model.predict_batch_into(envs.observations(), batch, q_batch.data());
+                    model.fit(envs.observations(), targets.data(), batch);
+                    sink = q_batch[0];
+                });
+                run("DQN::predict_sparse_batch+fit" + suffix + b, batch, [&] {
+                    model.predict_sparse_batch(envs.free_bits(), envs.pirate_cells(), pirate_mark, batch, q_batch.data());
+                    model.fit(envs.observations(), targets.data(), batch);
+                    sink = q_batch[0];
+                });
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    // Defaults cover the trainer's 8x8 maze up to the corpus sizes that still run in seconds
+    std::vector<int> env_sizes = { 8, 32, 128 };
+    std::vector<int> sizes = { 8, 32 };
+    std::vector<int> replay_batches = { 32, 256 };
+    std::vector<int> network_batches = { 8, 64, 256 };
+    std::vector<std::vector<int>> layouts = { { 64, 32, 16, 8, 4 }, { 256, 256 } };
+
+    int positional = 0;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--env-sizes" && has_value) ok = parse_list(argv[++i], ',', env_sizes);
+        else if (arg == "--sizes" && has_value) ok = parse_list(argv[++i], ',', sizes);
+        else if (arg == "--batches" && has_value) {
+            ok = parse_list(argv[++i], ',', network_batches);
+            replay_batches = network_batches;
+        }
+        else if (arg == "--layouts" && has_value) {
+            std::string list = argv[++i];
+            layouts.clear();
+            size_t pos = 0;
+            while (ok && pos <= list.size()) {
+                size_t end = std::min(list.find(',', pos), list.size());
+                layouts.emplace_back();
+                ok = parse_list(list.substr(pos, end - pos), 'x', layouts.back());
+                pos = end + 1;
+            }
+        }
+        else if (arg == "--min-time" && has_value) ok = (min_seconds = std::atof(argv[++i])) > 0;
+        else if (arg == "--iterations" && has_value) ok = (fixed_iterations = std::atoll(argv[++i])) > 0;
+        else if (arg.rfind("--", 0) != 0 && positional == 0) { filter = arg; ++positional; }
+        else if (arg.rfind("--", 0) != 0 && positional == 1) { corpus_dir = arg; ++positional; }
+        else ok = false;
+    }
+    if (!ok) {
+        std::fprintf(stderr, "Usage: %s [filter] [corpus_dir] [--env-sizes LIST] [--sizes LIST] [--batches LIST]"
+            " [--layouts LIST] [--min-time SECONDS | --iterations N]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("Kernels: %s\n", kernels::isa_name(kernels::active_isa()));
+    std::printf("%-56s %14s %12s %18s %12s\n", "Benchmark", "ns/op", "allocs/op", "throughput", "iterations");
+
+    bench_environment(env_sizes);
+    bench_replay(sizes, replay_batches);
+    bench_network(sizes, network_batches, layouts);
+    return 0;
+}
@@ -6,9 +6,15 @@
 #include <chrono>
 #include <numeric>
 #include <sstream>
-#include "TreasureMaze.h"
+#include <thread>
+#include "VectorMaze.h"
+#include "MazeGenerator.h"
 #include "GameExperience.h"
 #include "DQN.h"
+#include "MappedReplayStore.h"
+#ifdef WITH_MONGODB
+#include "MongoReplayStore.h"
+#endif
 
 // Global exploration factor
 float epsilon = 0.5f;
@@ -23,19 +29,11 @@ std::string format_time(double seconds) {
 }
 
 // Completion check stub
-bool completion_check(GameExperience& model, TreasureMaze& maze) {
+bool completion_check(GameExperience& model, VectorMaze& mazes) {
     return false; // placeholder for future logic
 }
 
-// Flatten maze helper
-std::vector<float> flatten_maze(const std::vector<std::vector<float>>& maze) {
-    std::vector<float> flat;
-    for (auto& row : maze)
-        for (float v : row) flat.push_back(v);
-    return flat;
-}
-
-int main() {
+int main(int argc, char** argv) {
     std::srand(static_cast<unsigned int>(std::time(nullptr)));
 
     // Maze definition
@@ -50,103 +48,198 @@ int main() {
         {1.,1.,1.,1.,0.,1.,1.,1.}
     };
 
-    TreasureMaze qmaze(maze);
+    // Generated mazes: a non-empty maze_file loads one (e.g. from the corpus), otherwise a
+    // maze_size above 0 generates a maze_size x maze_size grid in place of the one above
+    std::string maze_file = "";
+    int maze_size = 0;
+    float wall_density = 0.3f;
+    uint32_t maze_seed = 1;
+    std::string corpus_dir = "";  // non-empty: write the fixed benchmark corpus there and exit
+    int n_epoch = 15000;
+
+    // Update rule: sgd (the original trainer's), rmsprop or adam. lr 0 picks the rule's default step size
+    std::string optimizer_name = "sgd";
+    float lr = 0.0f;
+
+    // Command line overrides of the settings above
+    const char* usage = " [epochs] [--maze FILE | --size N [--density D] [--seed S]] [--build-corpus DIR]"
+        " [--optimizer sgd|rmsprop|adam] [--lr RATE]";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--maze" && has_value) maze_file = argv[++i];
+        else if (arg == "--size" && has_value) maze_size = std::atoi(argv[++i]);
+        else if (arg == "--density" && has_value) wall_density = (float)std::atof(argv[++i]);
+        else if (arg == "--seed" && has_value) maze_seed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--build-corpus" && has_value) corpus_dir = argv[++i];
+        else if (arg == "--optimizer" && has_value) optimizer_name = argv[++i];
+        else if (arg == "--lr" && has_value) lr = (float)std::atof(argv[++i]);
+        else if (!arg.empty() && arg[0] != '-') n_epoch = std::max(1, std::atoi(arg.c_str())); // e.g. a short profiling run
+        else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+
+    Optimizer optimizer;
+    if (optimizer_name == "sgd") optimizer = Optimizer::SGD;
+    else if (optimizer_name == "rmsprop") optimizer = Optimizer::RMSProp;
+    else if (optimizer_name == "adam") optimizer = Optimizer::Adam;
+    else {
+        std::cerr << "Unknown optimizer " << optimizer_name << "; use sgd, rmsprop or adam" << std::endl;
+        return 1;
+    }
+    if (lr <= 0.0f) lr = optimizer == Optimizer::SGD ? 0.005f : 0.001f;
+
+    // Write the fixed benchmark corpus (8x8 up to 256x256, same seeds every time) and exit
+    if (!corpus_dir.empty()) {
+        auto paths = build_maze_corpus(corpus_dir, { 8, 16, 32, 64, 128, 256 }, 4, wall_density, 2024);
+        std::cout << "Wrote " << paths.size() << " mazes to " << corpus_dir << std::endl;
+        return 0;
+    }
+
+    if (!maze_file.empty()) maze = load_maze(maze_file);
+    else if (maze_size > 0) maze = generate_maze(maze_size, maze_size, wall_density, maze_seed);
+
+    int num_envs = 8;            // games played side by side
+    VectorMaze envs(maze, num_envs);
 
     int input_size = static_cast<int>(maze.size() * maze[0].size());
     int num_actions = 4;
     int max_memory = 1000;       // more experience
     float discount = 0.95f;
-    float lr = 0.005f;          // faster learning
+    int num_threads = std::max(1, (int)std::thread::hardware_concurrency()); // training threads
 
     // Dynamic hidden layers
     std::vector<int> hidden_layers = { 64, 32, 16, 8, 4 }; // More values in the vector the more hidden layers
 
     // Initialize GameExperience with 5-hidden-layer DQN
-    GameExperience experience(input_size, num_actions, max_memory, discount, hidden_layers, lr);
+    GameExperience experience(input_size, num_actions, max_memory, discount, hidden_layers, lr, num_threads);
+
+    experience.model.set_optimizer(optimizer);
+
+    bool prioritized_replay = false; // sample by TD error instead of uniformly
+    if (prioritized_replay) experience.set_prioritized(true);
+
+    // Replay memory persistence: MongoDB, or a local memory-mapped file when no server is available
+#ifdef WITH_MONGODB
+    bool use_mongodb = true;
+    if (use_mongodb)
+        experience.set_replay_store(std::make_unique<MongoReplayStore>("mongodb://localhost:27017",
+            "game_db", "experience_buffer", StateEncoding::Packed2Bit)); // 16 bytes per maze state
+    else
+#endif
+        experience.set_replay_store(std::make_unique<MappedReplayStore>("experience_buffer.bin", input_size));
+
+    bool resume_experience = false; // warm start from the experience saved by a previous run
+    if (resume_experience) experience.load_memory_from_db();
+
+    // Model checkpoints: written every checkpoint_every epochs and once more when training ends
+    std::string checkpoint_path = "dqn_checkpoint.bin";
+    int checkpoint_every = 500;
+    bool resume_model = false; // continue from the last checkpoint instead of fresh weights
+    if (resume_model) {
+        experience.model.load_checkpoint(checkpoint_path);
+        experience.sync_target();
+    }
 
-    int n_epoch = 15000;
-    int data_size = 50;          // larger batch for training
+    int data_size = 50;          // training samples per game per step
 
     std::vector<int> win_history;
+    std::vector<float> inputs, targets; // training batch, reused every step
+    std::vector<float> prev_obs((size_t)num_envs * input_size); // observations before the step
+    std::vector<int> actions(num_envs);
+    std::vector<float> q_batch((size_t)num_envs * num_actions);
+    std::vector<int> n_episodes(num_envs, 0);
     int hsize = static_cast<int>((maze.size() * maze[0].size()) / 2);
 
     auto start_time = std::chrono::steady_clock::now();
 
-    for (int epoch = 0; epoch < n_epoch; ++epoch) {
-        // Pick random starting cell
-        auto& free_cells = qmaze.free_cells;
-        int idx = std::rand() % static_cast<int>(free_cells.size());
-        std::pair<int, int> agent_cell = free_cells[idx];
-
-        qmaze.reset(agent_cell);
-
-        int n_episodes = 0;
-        auto envstate = qmaze.observe();
+    // Every game starts on a random free cell; finished games are restarted the same way
+    auto random_start = [&]() {
+        return envs.free_cells[std::rand() % static_cast<int>(envs.free_cells.size())];
+    };
+    for (int e = 0; e < num_envs; ++e) envs.reset(e, random_start());
 
-        while (true) {
-            auto previous_envstate = envstate;
-            int action;
+    int epoch = 0;
+    while (epoch < n_epoch) {
+        // Q-values of every game's state in one batched pass over the bit-packed observations
+        std::copy(envs.observations(), envs.observations() + prev_obs.size(), prev_obs.begin());
+        experience.model.predict_sparse_batch(envs.free_bits(), envs.pirate_cells(), pirate_mark,
+            num_envs, q_batch.data());
 
-            // Epsilon-greedy exploration
+        // Epsilon-greedy exploration, per game
+        for (int e = 0; e < num_envs; ++e) {
             if ((static_cast<float>(std::rand()) / RAND_MAX) < epsilon) {
-                action = std::rand() % num_actions;
+                actions[e] = std::rand() % num_actions;
             }
             else {
-                auto q_values = experience.model.predict(flatten_maze(previous_envstate));
-                action = std::distance(q_values.begin(),
-                    std::max_element(q_values.begin(), q_values.end()));
+                // Greedy over the moves the maze allows from this cell
+                actions[e] = best_valid_action(q_batch.data() + (size_t)e * num_actions, envs.valid_moves(e));
             }
+        }
 
-            auto [next_env, reward, status] = qmaze.act(action);
-
-            // Flatten for storage
-            std::vector<float> flat_prev = flatten_maze(previous_envstate);
-            std::vector<float> flat_next = flatten_maze(next_env);
-
-            experience.remember({ flat_prev, action, reward, flat_next, status == "win" || status == "lose" });
-
-            // Train on batch
-            std::vector<std::vector<float>> inputs, targets;
-            experience.get_data(inputs, targets, data_size);
-            if (!inputs.empty()) experience.model.fit(inputs, targets);
+        envs.act(actions.data());
 
-            n_episodes++;
-            envstate = next_env;
+        for (int e = 0; e < num_envs; ++e) {
+            GameStatus status = envs.status(e);
+            experience.remember({ prev_obs.data() + (size_t)e * input_size, actions[e], envs.reward(e),
+                envs.observation(e), status != GameStatus::NotOver });
+            n_episodes[e]++;
+        }
 
-            if (status == "win" || status == "lose") {
-                win_history.push_back(status == "win" ? 1 : 0);
-                break;
+        // Train on one batch that grows with the number of games, keeping the replay ratio of a single game
+        int n_samples = experience.get_data(inputs, targets, data_size * num_envs);
+        if (n_samples > 0)
+            experience.model.fit(inputs.data(), targets.data(), n_samples, 1, experience.sample_weights());
+
+        // Each finished game counts as one epoch
+        bool done = false;
+        for (int e = 0; e < num_envs && !done; ++e) {
+            GameStatus status = envs.status(e);
+            if (status == GameStatus::NotOver) continue;
+
+            win_history.push_back(status == GameStatus::Win ? 1 : 0);
+
+            auto end_time = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double>(end_time - start_time).count();
+            std::string t = format_time(elapsed);
+
+            // Calculate rolling win rate
+            float win_rate = 0.0f;
+            if (!win_history.empty()) {
+                int wins = std::accumulate(win_history.end() - std::min((int)win_history.size(), hsize),
+                    win_history.end(), 0);
+                win_rate = static_cast<float>(wins) / hsize;
             }
-        }
 
-        auto end_time = std::chrono::steady_clock::now();
-        double elapsed = std::chrono::duration<double>(end_time - start_time).count();
-        std::string t = format_time(elapsed);
+            printf("Epoch: %03d/%d | Episodes: %d | Wins: %d | Win rate: %.3f | Time: %s\n",
+                epoch, n_epoch - 1, n_episodes[e],
+                std::accumulate(win_history.begin(), win_history.end(), 0),
+                win_rate, t.c_str());
 
-        // Calculate rolling win rate
-        float win_rate = 0.0f;
-        if (!win_history.empty()) {
-            int wins = std::accumulate(win_history.end() - std::min((int)win_history.size(), hsize),
-                win_history.end(), 0);
-            win_rate = static_cast<float>(wins) / hsize;
-        }
+            // Epsilon decay
+            epsilon = std::max(0.05f, epsilon * 0.995f);
 
-        printf("Epoch: %03d/%d | Episodes: %d | Wins: %d | Win rate: %.3f | Time: %s\n",
-            epoch, n_epoch - 1, n_episodes,
-            std::accumulate(win_history.begin(), win_history.end(), 0),
-            win_rate, t.c_str());
+            // MondoDB save check
+            experience.epoch_complete();
 
-        // Epsilon decay
-        epsilon = std::max(0.05f, epsilon * 0.995f);
+            if ((epoch + 1) % checkpoint_every == 0)
+                experience.model.save_checkpoint(checkpoint_path);
 
-        // MondoDB save check
-        experience.epoch_complete();
+            if ((int)win_history.size() >= hsize && completion_check(experience, envs)) {
+                std::cout << "Reached 100% win rate at epoch: " << epoch << std::endl;
+                done = true;
+            }
 
-        if ((int)win_history.size() >= hsize && completion_check(experience, qmaze)) {
-            std::cout << "Reached 100% win rate at epoch: " << epoch << std::endl;
-            break;
+            ++epoch;
+            done = done || epoch >= n_epoch;
+            n_episodes[e] = 0;
+            envs.reset(e, random_start());
         }
+        if (done) break;
     }
 
+    experience.model.save_checkpoint(checkpoint_path);
     return 0;
 }
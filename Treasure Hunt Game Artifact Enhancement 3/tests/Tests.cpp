@@ -0,0 +1,908 @@
+// Correctness checks for the kernels, network, storage formats and environment.
+//
+//     Tests [name]
+//
+// Runs every test (or only the one called name) and prints one line per failed check.
+// Exits non-zero if any check failed; ctest runs each test as its own case.
+//
+// Links against the trainer's sources except main.cpp and the MongoDB store.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../DQN.h"
+#include "../GameExperience.h"
+#include "../Kernels.h"
+#include "../MappedReplayStore.h"
+#include "../MazeGenerator.h"
+#include "../ReplayBuffer.h"
+#include "../StateCodec.h"
+#include "../SumTree.h"
+#include "../TreasureMaze.h"
+#include "../VectorMaze.h"
+
+// ----------------- Harness -----------------
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (ok) return;
+    std::printf("  FAILED: %s\n", what.c_str());
+    ++failures;
+}
+
+// Largest absolute difference between a[n] and b[n]
+float max_diff(const float* a, const float* b, size_t n) {
+    float diff = 0.0f;
+    for (size_t i = 0; i < n; ++i) diff = std::max(diff, std::fabs(a[i] - b[i]));
+    return diff;
+}
+
+void check_close(const std::vector<float>& a, const std::vector<float>& b, float tolerance, const std::string& what) {
+    if (a.size() != b.size()) {
+        check(false, what + ": sizes differ");
+        return;
+    }
+    float diff = max_diff(a.data(), b.data(), a.size());
+    check(diff <= tolerance, what + ": max difference " + std::to_string(diff));
+}
+
+std::vector<float> random_vector(size_t n, std::mt19937& rng, float lo = -1.0f, float hi = 1.0f) {
+    std::uniform_real_distribution<float> dist(lo, hi);
+    std::vector<float> v(n);
+    for (float& x : v) x = dist(rng);
+    return v;
+}
+
+std::string temp_path(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / ("treasure_tests_" + name)).string();
+}
+
+// ----------------- Kernels -----------------
+
+void test_kernels() {
+    const int n = 37, rows = 70, m = 5, k = 19;
+    std::mt19937 rng(1);
+    std::vector<float> x = random_vector(n, rng), y0 = random_vector(n, rng);
+    std::vector<float> bias = random_vector(n, rng), block = random_vector((size_t)m * n, rng);
+    std::vector<float> w = random_vector((size_t)rows * n, rng);
+    std::vector<float> grad = random_vector(n, rng), m0 = random_vector(n, rng), v0 = random_vector(n, rng, 0.0f, 1.0f);
+    std::vector<float> a_mk = random_vector((size_t)m * k, rng), b_kn = random_vector((size_t)k * n, rng);
+    std::vector<float> b_mn = random_vector((size_t)m * n, rng), b_km = random_vector((size_t)k * n, rng);
+    uint64_t bits[2] = { 0x9E3779B97F4A7C15ull, 0x2Full };
+
+    // Outputs of every kernel under the active instruction set, back to back
+    auto run_all = [&] {
+        std::vector<float> out;
+        auto append = [&](const std::vector<float>& v) { out.insert(out.end(), v.begin(), v.end()); };
+
+        std::vector<float> y = y0;
+        kernels::axpy(n, 0.3f, x.data(), y.data());
+        append(y);
+        out.push_back(kernels::dot(n, x.data(), y0.data()));
+
+        std::vector<float> b = block;
+        kernels::add_bias(m, n, bias.data(), b.data());
+        append(b);
+        b = block;
+        kernels::add_bias_relu(m, n, bias.data(), b.data());
+        append(b);
+        y = y0;
+        kernels::relu_backward(n, x.data(), y.data());
+        append(y);
+        y = y0;
+        kernels::add_rows_masked(rows, n, bits, w.data(), y.data());
+        append(y);
+
+        std::vector<float> p = y0, mo = m0, v = v0;
+        kernels::adam_update(n, 0.01f, 0.9f, 0.999f, 1e-8f, 0.25f, grad.data(), mo.data(), v.data(), p.data());
+        append(p); append(mo); append(v);
+        p = y0; v = v0;
+        kernels::rmsprop_update(n, 0.01f, 0.9f, 1e-8f, 0.25f, grad.data(), v.data(), p.data());
+        append(p); append(v);
+
+        std::vector<float> c((size_t)m * n, 0.5f);
+        kernels::gemm_nn(m, n, k, a_mk.data(), b_kn.data(), c.data());
+        append(c);
+        std::vector<float> ct((size_t)k * n, 0.5f);
+        kernels::gemm_tn(m, n, k, a_mk.data(), b_mn.data(), ct.data());
+        append(ct);
+        std::vector<float> cn((size_t)m * k, 0.5f);
+        kernels::gemm_nt(m, n, k, b_mn.data(), b_km.data(), cn.data());
+        append(cn);
+        return out;
+    };
+
+    kernels::Isa original = kernels::active_isa();
+    kernels::set_isa(kernels::Isa::Scalar);
+    std::vector<float> expected = run_all();
+
+    for (kernels::Isa isa : { kernels::Isa::SSE4, kernels::Isa::AVX2, kernels::Isa::AVX512 }) {
+        if (kernels::set_isa(isa) != isa) continue; // not supported here
+        check_close(run_all(), expected, 1e-5f, std::string("kernels ") + kernels::isa_name(isa) + " vs scalar");
+    }
+    kernels::set_isa(original);
+}
+
+// Plain triple loops the block kernels must reproduce
+void reference_gemm(int m, int n, int k, const float* a, size_t a_rs, size_t a_cs,
+    const float* b, size_t b_rs, size_t b_cs, float* c)
+{
+    for (int i = 0; i < m; ++i)
+        for (int j = 0; j < n; ++j) {
+            double sum = c[(size_t)i * n + j];
+            for (int p = 0; p < k; ++p) sum += (double)a[i * a_rs + p * a_cs] * b[p * b_rs + j * b_cs];
+            c[(size_t)i * n + j] = (float)sum;
+        }
+}
+
+// Shapes on both sides of the register tiles and the cache blocks, under every instruction set
+void test_gemm_shapes() {
+    const int shapes[][3] = { { 1, 1, 1 }, { 1, 37, 19 }, { 3, 5, 2 }, { 4, 16, 8 }, { 5, 33, 17 },
+        { 9, 47, 3 }, { 70, 260, 130 }, { 65, 17, 129 } };
+    std::mt19937 rng(2);
+    kernels::Isa original = kernels::active_isa();
+    for (kernels::Isa isa : { kernels::Isa::Scalar, kernels::Isa::SSE4, kernels::Isa::AVX2, kernels::Isa::AVX512 }) {
+        if (kernels::set_isa(isa) != isa) continue;
+        for (const auto& shape : shapes) {
+            int m = shape[0], n = shape[1], k = shape[2];
+            std::string what = std::string(kernels::isa_name(isa)) + " " + std::to_string(m) + "x"
+                + std::to_string(n) + "x" + std::to_string(k);
+
+            std::vector<float> a = random_vector((size_t)m * k, rng), b = random_vector((size_t)k * n, rng);
+            std::vector<float> c = random_vector((size_t)m * n, rng), expected = c;
+            kernels::gemm_nn(m, n, k, a.data(), b.data(), c.data());
+            reference_gemm(m, n, k, a.data(), k, 1, b.data(), n, 1, expected.data());
+            check_close(c, expected, 1e-5f * k, "gemm_nn " + what);
+
+            // C[k x n] += A[m x k]^T * B[m x n]
+            std::vector<float> bm = random_vector((size_t)m * n, rng);
+            std::vector<float> ct = random_vector((size_t)k * n, rng), expected_t = ct;
+            kernels::gemm_tn(m, n, k, a.data(), bm.data(), ct.data());
+            reference_gemm(k, n, m, a.data(), 1, k, bm.data(), n, 1, expected_t.data());
+            check_close(ct, expected_t, 1e-5f * m, "gemm_tn " + what);
+
+            // C[m x k] += A[m x n] * B[k x n]^T
+            std::vector<float> bk = random_vector((size_t)k * n, rng);
+            std::vector<float> cn = random_vector((size_t)m * k, rng), expected_n = cn;
+            kernels::gemm_nt(m, n, k, bm.data(), bk.data(), cn.data());
+            reference_gemm(m, k, n, bm.data(), n, 1, bk.data(), 1, n, expected_n.data());
+            check_close(cn, expected_n, 1e-5f * n, "gemm_nt " + what);
+        }
+    }
+    kernels::set_isa(original);
+}
+
+// ----------------- Network -----------------
+
+// The sparse first layer must reproduce the dense forward pass on the same observations
+void test_sparse_predict() {
+    auto grid = generate_maze(12, 12, 0.3f, 3);
+    const int num_envs = 6;
+    VectorMaze envs(grid, num_envs);
+    std::mt19937 rng(5);
+    for (int e = 0; e < num_envs; ++e) envs.reset(e, envs.free_cells[rng() % envs.free_cells.size()]);
+    std::vector<int> actions(num_envs);
+    for (int& a : actions) a = rng() & 3;
+    envs.act(actions.data());
+
+    DQN model(envs.cells(), { 32, 16 }, 4);
+    std::vector<float> dense = model.predict_batch(envs.observations(), num_envs);
+    std::vector<float> sparse(dense.size());
+    model.predict_sparse_batch(envs.free_bits(), envs.pirate_cells(), pirate_mark, num_envs, sparse.data());
+    check_close(sparse, dense, 1e-5f, "predict_sparse_batch vs predict_batch");
+
+    // The cached free-cell sum must follow weight updates
+    std::vector<float> targets(dense.size(), 0.25f);
+    model.fit(envs.observations(), targets.data(), num_envs);
+    dense = model.predict_batch(envs.observations(), num_envs);
+    model.predict_sparse_batch(envs.free_bits(), envs.pirate_cells(), pirate_mark, num_envs, sparse.data());
+    check_close(sparse, dense, 1e-5f, "predict_sparse_batch after fit");
+
+    std::vector<float> into(dense.size());
+    model.predict_batch_into(envs.observations(), num_envs, into.data());
+    check_close(into, dense, 0.0f, "predict_batch_into vs predict_batch");
+}
+
+// Sharding a batch across threads must give the same update as one thread. The weights are
+// randomly initialised, so the step is kept small: a large one can amplify rounding differences
+// between the sharded and unsharded gradient sums into a different ReLU pattern
+void test_threaded_fit() {
+    const int inputs = 20, batch = 96;
+    std::mt19937 rng(7);
+    std::vector<float> x = random_vector((size_t)batch * inputs, rng, 0.0f, 1.0f);
+    std::vector<float> t = random_vector((size_t)batch * 4, rng);
+
+    for (Optimizer opt : { Optimizer::SGD, Optimizer::RMSProp, Optimizer::Adam }) {
+        DQN single(inputs, { 24, 12 }, 4, 0.001f);
+        DQN threaded(inputs, { 24, 12 }, 4, 0.001f);
+        threaded.copy_weights_from(single);
+        single.set_optimizer(opt);
+        threaded.set_optimizer(opt);
+        threaded.set_num_threads(4);
+
+        for (int step = 0; step < 5; ++step) {
+            single.fit(x.data(), t.data(), batch);
+            threaded.fit(x.data(), t.data(), batch);
+        }
+        check_close(threaded.predict_batch(x.data(), batch), single.predict_batch(x.data(), batch), 1e-4f,
+            "threaded vs single-threaded fit, optimizer " + std::to_string((int)opt));
+    }
+}
+
+// A checkpoint restores weights and optimizer state exactly, and corrupt files are rejected
+void test_checkpoint() {
+    std::string path = temp_path("checkpoint.bin");
+    std::mt19937 rng(11);
+    std::vector<float> x = random_vector(16 * 10, rng, 0.0f, 1.0f), t = random_vector(16 * 4, rng);
+
+    DQN model(10, { 16, 8 }, 4, 0.005f);
+    model.set_optimizer(Optimizer::Adam);
+    model.fit(x.data(), t.data(), 16);
+    model.save_checkpoint(path);
+    model.save_checkpoint(path); // replacing an existing checkpoint
+    check(!std::filesystem::exists(path + ".tmp"), "the temporary file is renamed into place");
+
+    DQN restored = DQN::from_checkpoint(path);
+    check(restored.get_optimizer() == Optimizer::Adam, "from_checkpoint restores the optimizer");
+    check_close(restored.predict_batch(x.data(), 16), model.predict_batch(x.data(), 16), 0.0f, "from_checkpoint weights");
+
+    DQN loaded(10, { 16, 8 }, 4, 0.005f);
+    loaded.set_optimizer(Optimizer::Adam);
+    loaded.load_checkpoint(path);
+
+    // Identical moments give identical next steps
+    model.fit(x.data(), t.data(), 16);
+    restored.fit(x.data(), t.data(), 16);
+    loaded.fit(x.data(), t.data(), 16);
+    std::vector<float> expected = model.predict_batch(x.data(), 16);
+    check_close(restored.predict_batch(x.data(), 16), expected, 0.0f, "from_checkpoint optimizer state");
+    check_close(loaded.predict_batch(x.data(), 16), expected, 0.0f, "load_checkpoint optimizer state");
+
+    bool threw = false;
+    try {
+        DQN other(12, { 16, 8 }, 4);
+        other.load_checkpoint(path);
+    }
+    catch (const std::runtime_error&) { threw = true; }
+    check(threw, "load_checkpoint rejects a different shape");
+
+    // Corrupt headers and truncations must throw, never build a network or read out of bounds
+    std::vector<char> bytes(std::filesystem::file_size(path));
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    check(f && std::fread(bytes.data(), 1, bytes.size(), f) == bytes.size(), "read checkpoint back");
+    if (f) std::fclose(f);
+    int accepted_corrupt = 0;
+    for (int trial = 0; trial < 500; ++trial) {
+        std::vector<char> damaged = bytes;
+        damaged[8 + rng() % 24] = (char)rng(); // layer, parameter and optimizer state counts
+        if (trial % 5 == 0) damaged.resize(rng() % bytes.size());
+        std::string damaged_path = temp_path("checkpoint_damaged.bin");
+        f = std::fopen(damaged_path.c_str(), "wb");
+        std::fwrite(damaged.data(), 1, damaged.size(), f);
+        std::fclose(f);
+        try {
+            DQN::from_checkpoint(damaged_path);
+            if (damaged != bytes) ++accepted_corrupt;
+        }
+        catch (const std::runtime_error&) {}
+        std::remove(damaged_path.c_str());
+    }
+    check(accepted_corrupt == 0, std::to_string(accepted_corrupt) + " corrupt checkpoints were accepted");
+    std::remove(path.c_str());
+}
+
+// ----------------- Replay and targets -----------------
+
+// One remembered step; state[0] holds the step's index so a sampled row can be traced back
+struct Transition {
+    std::vector<float> state, next;
+    int action;
+    float reward;
+    bool done;
+};
+
+std::vector<Transition> make_transitions(int n, int state_size, std::mt19937& rng) {
+    std::vector<Transition> history(n);
+    for (int i = 0; i < n; ++i) {
+        Transition& t = history[i];
+        t.state = random_vector(state_size, rng);
+        t.state[0] = (float)i;
+        t.next = random_vector(state_size, rng);
+        t.action = i % 4;
+        t.reward = 0.1f * i - 0.3f;
+        t.done = i % 3 == 0;
+    }
+    return history;
+}
+
+void remember_all(GameExperience& experience, const std::vector<Transition>& history) {
+    for (const Transition& t : history)
+        experience.remember({ t.state.data(), t.action, t.reward, t.next.data(), t.done });
+}
+
+// Each row of a get_data batch must be Q(s) with Q(s, a) replaced by r + discount * max Q'(s'),
+// where Q is experience.model and Q' is target_net
+void check_targets(GameExperience& experience, DQN& target_net, const std::vector<Transition>& history,
+    const std::vector<float>& inputs, const std::vector<float>& targets, int n, float discount, const std::string& what)
+{
+    const size_t state_size = history[0].state.size();
+    for (int row = 0; row < n; ++row) {
+        const float* input = inputs.data() + row * state_size;
+        const Transition& t = history.at((size_t)input[0]);
+        std::string step = what + ": step " + std::to_string((int)input[0]);
+        check(std::equal(t.state.begin(), t.state.end(), input), step + " input");
+
+        std::vector<float> expected = experience.model.predict(t.state);
+        float next_max = 0.0f;
+        if (!t.done) {
+            std::vector<float> q = target_net.predict(t.next);
+            next_max = *std::max_element(q.begin(), q.end());
+        }
+        expected[t.action] = t.reward + discount * next_max;
+        std::vector<float> actual(targets.begin() + (size_t)row * 4, targets.begin() + (size_t)row * 4 + 4);
+        check_close(actual, expected, 1e-5f, step + " targets");
+    }
+}
+
+void test_get_data() {
+    const int state_size = 6, n = 9;
+    const float discount = 0.9f;
+    std::mt19937 rng(11);
+    std::vector<Transition> history = make_transitions(n, state_size, rng);
+    GameExperience experience(state_size, 4, 16, discount, { 8 });
+    remember_all(experience, history);
+
+    std::vector<float> inputs, targets;
+    int batch = experience.get_data(inputs, targets, 32);
+    check(batch == n, "batch is capped at the memory size");
+    check(targets.size() == (size_t)batch * 4, "targets are [batch x actions]");
+
+    // Sampling without replacement: every step exactly once
+    std::vector<int> steps;
+    for (int row = 0; row < batch; ++row) steps.push_back((int)inputs[(size_t)row * state_size]);
+    std::sort(steps.begin(), steps.end());
+    for (int i = 0; i < n; ++i) check(steps[i] == i, "step " + std::to_string(i) + " sampled once");
+
+    // The target network starts as a copy of the model
+    check_targets(experience, experience.model, history, inputs, targets, batch, discount, "get_data");
+
+    // A terminal step's target is its reward alone
+    for (int row = 0; row < batch; ++row) {
+        const Transition& t = history[(size_t)inputs[(size_t)row * state_size]];
+        if (t.done) check(targets[(size_t)row * 4 + t.action] == t.reward, "game_over target is the reward");
+    }
+}
+
+// The cached max Q(s') must follow the target network: kept while the online network trains,
+// dropped when the target is copied
+void test_target_cache() {
+    const int state_size = 6, n = 9;
+    const float discount = 0.9f;
+    std::mt19937 rng(12);
+    std::vector<Transition> history = make_transitions(n, state_size, rng);
+    GameExperience experience(state_size, 4, 16, discount, { 8 });
+    experience.set_target_sync_interval(1000);
+    remember_all(experience, history);
+
+    std::vector<float> inputs, targets;
+    int batch = experience.get_data(inputs, targets, n); // fills the cache
+    DQN frozen(state_size, { 8 }, 4);
+    frozen.copy_weights_from(experience.model);
+
+    // Train the online network away from the target network
+    for (float& x : targets) x += 1.0f;
+    experience.model.fit(inputs.data(), targets.data(), batch, 20);
+    float moved = 0.0f;
+    for (const Transition& t : history)
+        moved = std::max(moved, max_diff(frozen.predict(t.next).data(), experience.model.predict(t.next).data(), 4));
+    check(moved > 1e-3f, "training changed the online network");
+
+    batch = experience.get_data(inputs, targets, n);
+    check_targets(experience, frozen, history, inputs, targets, batch, discount, "before sync");
+
+    experience.sync_target();
+    batch = experience.get_data(inputs, targets, n);
+    check_targets(experience, experience.model, history, inputs, targets, batch, discount, "after sync");
+}
+
+// Consecutive steps share a frame; every live slot must still see its own states after the
+// transition and frame rings wrap, including at game boundaries where nothing is shared
+void test_replay_wraparound() {
+    const int capacity = 5, state_size = 3, steps = 40;
+    std::mt19937 rng(13);
+    std::vector<Transition> history;
+    ReplayBuffer memory(capacity, state_size);
+    std::vector<float> state = random_vector(state_size, rng);
+    for (int i = 0; i < steps; ++i) {
+        Transition t{ state, random_vector(state_size, rng), (int)(rng() % 4), 0.5f * i, rng() % 4 == 0 };
+        memory.push(t.state.data(), t.action, t.reward, t.next.data(), t.done);
+        history.push_back(t);
+        state = t.done ? random_vector(state_size, rng) : t.next;
+
+        uint64_t oldest = memory.inserted() - memory.size();
+        for (uint64_t seq = oldest; seq < memory.inserted(); ++seq) {
+            const Transition& e = history[seq];
+            int slot = (int)(seq % capacity);
+            std::string what = "after " + std::to_string(i + 1) + " pushes, seq " + std::to_string(seq);
+            check(std::equal(e.state.begin(), e.state.end(), memory.state(slot)), what + " envstate");
+            check(std::equal(e.next.begin(), e.next.end(), memory.next_state(slot)), what + " envstate_next");
+            check(memory.action(slot) == e.action && memory.reward(slot) == e.reward
+                && memory.game_over(slot) == e.done, what + " action, reward, game_over");
+        }
+    }
+
+    TransitionBatch batch;
+    memory.copy_since(steps - 3, batch);
+    check(batch.first_seq == steps - 3 && batch.size() == 3, "copy_since returns the newest three");
+    for (int i = 0; i < batch.size(); ++i) {
+        const Transition& e = history[batch.first_seq + i];
+        check(std::equal(e.next.begin(), e.next.end(), batch.next_states.begin() + (size_t)i * state_size),
+            "copy_since envstate_next " + std::to_string(i));
+    }
+}
+
+void test_sum_tree() {
+    SumTree tree(5);
+    const float priorities[5] = { 1.0f, 0.0f, 2.0f, 0.5f, 1.5f };
+    for (int slot = 0; slot < 5; ++slot) tree.update(slot, priorities[slot]);
+    check(tree.total() == 5.0f, "sum tree total");
+    check(tree.find(0.5f) == 0 && tree.find(1.0f) == 2 && tree.find(2.9f) == 2 && tree.find(3.2f) == 3 && tree.find(4.9f) == 4,
+        "sum tree prefix search");
+    tree.update(2, 0.0f);
+    check(tree.total() == 3.0f && tree.find(1.2f) == 3, "sum tree update");
+}
+
+// New transitions start at equal priority; after one pass the TD errors take over the sampling,
+// and the importance-sampling weights stay in (0, 1]
+void test_prioritized() {
+    const int state_size = 6, n = 8, heavy = 5;
+    std::mt19937 rng(14);
+    std::vector<Transition> history = make_transitions(n, state_size, rng);
+    for (Transition& t : history) {
+        t.reward = 0.0f;
+        t.done = true; // targets are the reward alone, so each TD error stays fixed without training
+    }
+    history[heavy].reward = 100.0f;
+    GameExperience experience(state_size, 4, 16, 0.9f, { 8 });
+    experience.set_prioritized(true, 1.0f, 0.4f);
+    remember_all(experience, history);
+
+    auto draw = [&](std::vector<int>& counts) {
+        std::vector<float> inputs, targets;
+        int batch = experience.get_data(inputs, targets, n);
+        const float* weights = experience.sample_weights();
+        check(weights != nullptr, "prioritized batches have weights");
+        if (!weights) return;
+        float max_weight = 0.0f;
+        for (int row = 0; row < batch; ++row) {
+            check(weights[row] > 0.0f && weights[row] <= 1.0f, "weight " + std::to_string(weights[row]) + " in (0, 1]");
+            max_weight = std::max(max_weight, weights[row]);
+            ++counts[(size_t)inputs[(size_t)row * state_size]];
+        }
+        check(max_weight == 1.0f, "weights are normalised by the largest");
+    };
+
+    // Equal priorities: one stratum per slot
+    std::vector<int> first(n, 0);
+    draw(first);
+    check(std::all_of(first.begin(), first.end(), [](int c) { return c == 1; }), "first batch samples every slot once");
+
+    std::vector<int> later(n, 0);
+    for (int i = 0; i < 50; ++i) draw(later);
+    int drawn = 50 * n;
+    check(later[heavy] > drawn / 2, "large TD error dominates sampling: " + std::to_string(later[heavy]) + " of " + std::to_string(drawn));
+}
+
+// ----------------- Persistence -----------------
+
+// Both binary encodings must round-trip maze observations exactly and refuse what they cannot hold
+void test_state_codec() {
+    const int n = 29;
+    std::vector<float> state(n);
+    for (int i = 0; i < n; ++i) state[i] = (i % 3) * 0.5f;
+
+    for (StateEncoding encoding : { StateEncoding::Float32, StateEncoding::Packed2Bit }) {
+        std::string name = encoding_name(encoding);
+        StateEncoding parsed;
+        check(encoding_from_name(name, parsed) && parsed == encoding, name + " name round trip");
+
+        std::vector<uint8_t> bytes(encoded_size(encoding, n));
+        std::vector<float> decoded(n, -1.0f);
+        check(encode_state(encoding, state.data(), n, bytes.data()), name + " encode");
+        check(decode_state(encoding, bytes.data(), bytes.size(), n, decoded.data()), name + " decode");
+        check_close(decoded, state, 0.0f, name + " round trip");
+        check(!decode_state(encoding, bytes.data(), bytes.size() + 1, n, decoded.data()), name + " rejects a wrong size");
+    }
+    check(encoded_size(StateEncoding::Packed2Bit, n) == 8, "packed2 uses 2 bits per cell");
+
+    std::vector<float> visited = state;
+    visited[4] = visited_mark;
+    std::vector<uint8_t> bytes(encoded_size(StateEncoding::Packed2Bit, n));
+    check(!encode_state(StateEncoding::Packed2Bit, visited.data(), n, bytes.data()), "packed2 rejects unknown cell values");
+}
+
+// Transitions first_seq.. with recognisable states; action < 0 cycles through the four actions
+TransitionBatch make_batch(uint64_t first_seq, int n, int state_size, int action) {
+    TransitionBatch batch;
+    batch.state_size = state_size;
+    batch.first_seq = first_seq;
+    for (int i = 0; i < n; ++i) {
+        for (int c = 0; c < state_size; ++c) {
+            batch.states.push_back((float)(first_seq + i) + 0.01f * c);
+            batch.next_states.push_back(-(float)(first_seq + i) - 0.01f * c);
+        }
+        batch.actions.push_back(action >= 0 ? action : i % 4);
+        batch.rewards.push_back(0.5f * i);
+        batch.done.push_back(i % 3 == 0);
+    }
+    return batch;
+}
+
+void test_mapped_replay_store() {
+    const int state_size = 6;
+    std::string path = temp_path("replay.bin");
+    std::remove(path.c_str());
+
+    {
+        MappedReplayStore store(path, state_size);
+        check(store.next_seq() == 0, "empty store starts at seq 0");
+        store.save(make_batch(0, 5, state_size, -1));
+        store.save(make_batch(5, 3, state_size, -1));
+        check(store.next_seq() == 8, "next_seq follows the newest record");
+    }
+
+    ReplayBuffer memory(6, state_size);
+    uint64_t next_seq = 0;
+    MappedReplayStore reader(path, state_size);
+    check(reader.load(memory, 4, next_seq) == 6 && next_seq == 8, "load keeps the newest capacity records");
+    bool same = true;
+    for (int i = 0; i < memory.size(); ++i) {
+        int seq = 2 + i;
+        same = same && memory.state(i)[1] == (float)seq + 0.01f && memory.next_state(i)[0] == -(float)seq &&
+            memory.action(i) == (seq < 5 ? seq : seq - 5) % 4 && memory.game_over(i) == ((seq < 5 ? seq : seq - 5) % 3 == 0);
+    }
+    check(same, "loaded records match what was saved");
+
+    // An interrupted write leaves a torn record; appending must not misalign what follows
+    std::FILE* f = std::fopen(path.c_str(), "ab");
+    std::fwrite("0123456789", 1, 10, f);
+    std::fclose(f);
+    check(reader.load(memory, 4, next_seq) == 6 && next_seq == 8, "load ignores a torn tail");
+    {
+        MappedReplayStore store(path, state_size);
+        store.save(make_batch(8, 2, state_size, 3));
+        store.save(make_batch(10, 1, state_size, 9)); // out-of-range action
+    }
+    ReplayBuffer resumed(16, state_size);
+    check(reader.load(resumed, 4, next_seq) == 10 && next_seq == 10, "append after a torn tail stays aligned");
+    check(resumed.action(8) == 3 && resumed.action(9) == 3 && resumed.state(9)[0] == 9.0f, "records after the torn tail");
+
+    // A file in another layout is replaced, not appended to
+    {
+        MappedReplayStore store(path, state_size + 1);
+        check(store.next_seq() == 0, "a different layout starts over");
+        store.save(make_batch(0, 2, state_size + 1, 1));
+    }
+    MappedReplayStore wider(path, state_size + 1);
+    ReplayBuffer wide_memory(4, state_size + 1);
+    check(wider.load(wide_memory, 4, next_seq) == 2, "records of the new layout load");
+    std::remove(path.c_str());
+}
+
+// Records the sequence range of every batch it is handed; can be told to fail the next save
+struct RecordingStore : ReplayStore {
+    std::vector<std::pair<uint64_t, int>>& saves;
+    bool& fail_next;
+
+    RecordingStore(std::vector<std::pair<uint64_t, int>>& saves, bool& fail_next) : saves(saves), fail_next(fail_next) {}
+
+    void save(TransitionBatch&& batch) override {
+        if (fail_next) {
+            fail_next = false;
+            throw std::runtime_error("store unavailable");
+        }
+        saves.push_back({ batch.first_seq, batch.size() });
+    }
+    uint64_t next_seq() override { return saves.empty() ? 0 : saves.back().first + saves.back().second; }
+    int load(ReplayBuffer& memory, int, uint64_t& next_seq) override {
+        memory.clear();
+        next_seq = this->next_seq();
+        return 0;
+    }
+};
+
+// Each save sends only what came after the previous successful one, and numbering resumes
+// after the newest stored transition when a run restarts from the store
+void test_delta_save() {
+    const int state_size = 6;
+    std::mt19937 rng(15);
+    std::vector<Transition> history = make_transitions(12, state_size, rng);
+    auto remember_range = [&](GameExperience& experience, int from, int to) {
+        for (int i = from; i < to; ++i) {
+            const Transition& t = history[i];
+            experience.remember({ t.state.data(), t.action, t.reward, t.next.data(), t.done });
+        }
+    };
+
+    {
+        std::vector<std::pair<uint64_t, int>> saves;
+        bool fail_next = false;
+        GameExperience experience(state_size, 4, 16, 0.9f, { 8 });
+        experience.set_replay_store(std::make_unique<RecordingStore>(saves, fail_next));
+        remember_range(experience, 0, 5);
+        experience.save_memory_to_db();
+        remember_range(experience, 5, 7);
+        experience.save_memory_to_db();
+        experience.save_memory_to_db(); // nothing new
+        check(saves == std::vector<std::pair<uint64_t, int>>{ { 0, 5 }, { 5, 2 } }, "saves send only new seqs");
+
+        remember_range(experience, 7, 8);
+        fail_next = true;
+        bool threw = false;
+        try {
+            experience.save_memory_to_db();
+        }
+        catch (const std::runtime_error&) {
+            threw = true;
+        }
+        check(threw, "store failure reaches the caller");
+        remember_range(experience, 8, 9);
+        experience.save_memory_to_db();
+        check(saves.size() == 3 && saves.back() == std::make_pair<uint64_t, int>(7, 2), "failed save is retried with the next one");
+    }
+
+    std::string path = temp_path("delta.bin");
+    std::remove(path.c_str());
+    {
+        GameExperience first(state_size, 4, 16, 0.9f, { 8 });
+        first.set_replay_store(std::make_unique<MappedReplayStore>(path, state_size));
+        remember_range(first, 0, 7);
+    } // saved on destruction
+    {
+        GameExperience resumed(state_size, 4, 16, 0.9f, { 8 });
+        resumed.set_replay_store(std::make_unique<MappedReplayStore>(path, state_size));
+        check(resumed.load_memory_from_db() == 7, "reload finds the first run's transitions");
+        resumed.save_memory_to_db(); // the reloaded transitions are not written again
+        remember_range(resumed, 7, 10);
+    }
+    {
+        GameExperience fresh(state_size, 4, 16, 0.9f, { 8 });
+        fresh.set_replay_store(std::make_unique<MappedReplayStore>(path, state_size));
+        remember_range(fresh, 10, 12); // numbered after the store's newest without loading it
+    }
+
+    MappedReplayStore store(path, state_size);
+    check(store.next_seq() == 12, "next_seq after three runs is " + std::to_string(store.next_seq()));
+    ReplayBuffer memory(16, state_size);
+    uint64_t next_seq = 0;
+    check(store.load(memory, 4, next_seq) == 12 && next_seq == 12, "store holds each transition once");
+    for (int i = 0; i < memory.size(); ++i)
+        check(memory.state(i)[0] == (float)i, "stored in seq order: step " + std::to_string(i));
+    std::remove(path.c_str());
+}
+
+// ----------------- Environment -----------------
+
+std::pair<int, int> first_free_cell(const std::vector<std::vector<float>>& grid) {
+    for (int r = 0; r < (int)grid.size(); ++r)
+        for (int c = 0; c < (int)grid[r].size(); ++c)
+            if (grid[r][c] == 1.0f) return { r, c };
+    return { 0, 0 };
+}
+
+// Flat observation of a 2D canvas from TreasureMaze::act / observe
+std::vector<float> flatten(const std::vector<std::vector<float>>& canvas) {
+    std::vector<float> flat;
+    for (const auto& row : canvas) flat.insert(flat.end(), row.begin(), row.end());
+    return flat;
+}
+
+// The allocation-free step must give exactly what act returns, through wins, losses and restarts
+void test_maze_step() {
+    for (int size : { 8, 13 }) {
+        auto grid = generate_maze(size, size, 0.3f, 9);
+        TreasureMaze by_act(grid, first_free_cell(grid));
+        TreasureMaze by_step(grid, first_free_cell(grid));
+        std::vector<float> obs(by_step.cells());
+        by_step.observe_into(obs.data());
+
+        std::mt19937 rng(size);
+        int mismatches = 0;
+        for (int i = 0; i < 20000; ++i) {
+            int action = (int)(rng() % 5); // 4 is never valid
+            auto [canvas, act_reward, act_status] = by_act.act(action);
+            float step_reward;
+            GameStatus step_status = by_step.step(action, obs.data(), step_reward);
+            if (act_reward != step_reward || act_status != step_status || flatten(canvas) != obs)
+                ++mismatches;
+
+            if (step_status != GameStatus::NotOver) {
+                auto start = by_step.free_cells[rng() % by_step.free_cells.size()];
+                by_act.reset(start);
+                by_step.reset(start);
+                by_step.observe_into(obs.data());
+            }
+        }
+        check(mismatches == 0, std::to_string(mismatches) + " act / step mismatches on " + std::to_string(size) + "x" + std::to_string(size));
+    }
+}
+
+// valid_actions must list exactly the moves that do not end in a wall or off the grid
+void test_valid_actions() {
+    auto grid = generate_maze(13, 13, 0.3f, 9);
+    TreasureMaze maze(grid, first_free_cell(grid));
+    const int dr[4] = { 0, -1, 0, 1 }, dc[4] = { -1, 0, 1, 0 }; // LEFT, UP, RIGHT, DOWN
+    for (int r = 0; r < 13; ++r)
+        for (int c = 0; c < 13; ++c) {
+            if (grid[r][c] == 0.0f) continue;
+            std::vector<int> expected;
+            for (int a = 0; a < 4; ++a) {
+                int nr = r + dr[a], nc = c + dc[a];
+                if (nr >= 0 && nr < 13 && nc >= 0 && nc < 13 && grid[nr][nc] != 0.0f) expected.push_back(a);
+            }
+            ValidActions valid = maze.valid_actions({ r, c });
+            check(std::vector<int>(valid.begin(), valid.end()) == expected,
+                "valid actions of cell " + std::to_string(r) + "," + std::to_string(c));
+        }
+}
+
+// FNV-1a over the cells, for pinning a generated maze
+uint64_t maze_hash(const std::vector<std::vector<float>>& grid) {
+    uint64_t hash = 1469598103934665603ull;
+    for (const auto& row : grid)
+        for (float cell : row) hash = (hash ^ (cell != 0.0f ? 1u : 0u)) * 1099511628211ull;
+    return hash;
+}
+
+// Every open cell must reach the treasure, the density bound must hold, and a seed must always
+// give the same maze
+void test_maze_generator() {
+    const int shapes[][2] = { { 2, 2 }, { 8, 8 }, { 7, 12 }, { 13, 13 }, { 64, 64 } };
+    for (const auto& shape : shapes) {
+        int rows = shape[0], cols = shape[1];
+        for (float density : { 0.0f, 0.3f, 0.6f }) {
+            for (uint32_t seed : { 1u, 2u, 77u }) {
+                auto grid = generate_maze(rows, cols, density, seed);
+                std::string what = std::to_string(rows) + "x" + std::to_string(cols) + " density "
+                    + std::to_string(density) + " seed " + std::to_string(seed);
+                check(grid == generate_maze(rows, cols, density, seed), what + " is deterministic");
+                check(grid[rows - 1][cols - 1] == 1.0f, what + " treasure cell is open");
+
+                // Flood fill from the treasure
+                std::vector<uint8_t> reached((size_t)rows * cols, 0);
+                std::vector<int> frontier = { rows * cols - 1 };
+                reached.back() = 1;
+                int open = 0, walls = 0;
+                while (!frontier.empty()) {
+                    int cell = frontier.back();
+                    frontier.pop_back();
+                    int r = cell / cols, c = cell % cols;
+                    const int next[4][2] = { { r, c - 1 }, { r - 1, c }, { r, c + 1 }, { r + 1, c } };
+                    for (const auto& n : next)
+                        if (n[0] >= 0 && n[0] < rows && n[1] >= 0 && n[1] < cols && grid[n[0]][n[1]] == 1.0f &&
+                            !reached[(size_t)n[0] * cols + n[1]]) {
+                            reached[(size_t)n[0] * cols + n[1]] = 1;
+                            frontier.push_back(n[0] * cols + n[1]);
+                        }
+                }
+                bool connected = true;
+                for (int r = 0; r < rows; ++r)
+                    for (int c = 0; c < cols; ++c) {
+                        if (grid[r][c] == 1.0f) ++open;
+                        else if (grid[r][c] == 0.0f) ++walls;
+                        connected = connected && (grid[r][c] != 1.0f || reached[(size_t)r * cols + c]);
+                    }
+                check(open + walls == rows * cols, what + " holds only 0 and 1");
+                check(connected, what + " every open cell reaches the treasure");
+                if (density < 0.5f)
+                    check(walls <= (int)(density * rows * cols), what + " walls " + std::to_string(walls));
+            }
+        }
+    }
+
+    check(generate_maze(32, 32, 0.3f, 1) != generate_maze(32, 32, 0.3f, 2), "different seeds give different mazes");
+    // Pinned so a change to the generator or to the engine's sequence shows up here
+    check(maze_hash(generate_maze(32, 32, 0.3f, 2024)) == 17287152551808191704ull, "32x32 seed 2024 is unchanged: "
+        + std::to_string(maze_hash(generate_maze(32, 32, 0.3f, 2024))));
+}
+
+// Games stepped side by side must each follow TreasureMaze's rules, observations and rewards
+void test_vector_maze() {
+    const int num_envs = 3;
+    for (int size : { 8, 13 }) {
+        auto grid = generate_maze(size, size, 0.3f, 9);
+        VectorMaze envs(grid, num_envs);
+        std::vector<TreasureMaze> games;
+        std::vector<std::vector<float>> obs(num_envs);
+        std::mt19937 rng(size);
+        for (int e = 0; e < num_envs; ++e) {
+            auto start = envs.free_cells[rng() % envs.free_cells.size()];
+            games.emplace_back(grid, start);
+            envs.reset(e, start);
+            obs[e].resize(envs.cells());
+            games[e].observe_into(obs[e].data());
+        }
+
+        int mismatches = 0;
+        std::vector<int> actions(num_envs);
+        for (int i = 0; i < 10000; ++i) {
+            for (int& a : actions) a = (int)(rng() % 5); // 4 is never valid
+            envs.act(actions.data());
+            for (int e = 0; e < num_envs; ++e) {
+                float reward;
+                GameStatus status = games[e].step(actions[e], obs[e].data(), reward);
+                if (envs.reward(e) != reward || envs.status(e) != status ||
+                    !std::equal(obs[e].begin(), obs[e].end(), envs.observation(e)))
+                    ++mismatches;
+                if (status != GameStatus::NotOver) {
+                    auto start = envs.free_cells[rng() % envs.free_cells.size()];
+                    games[e].reset(start);
+                    envs.reset(e, start);
+                    games[e].observe_into(obs[e].data());
+                }
+            }
+        }
+        check(mismatches == 0, std::to_string(mismatches) + " VectorMaze / TreasureMaze mismatches on "
+            + std::to_string(size) + "x" + std::to_string(size));
+    }
+
+    // The only open cell is the treasure, so no game can start
+    bool threw = false;
+    try {
+        VectorMaze no_start({ { 0.0f, 0.0f }, { 0.0f, 1.0f } }, 1);
+    }
+    catch (const std::invalid_argument&) { threw = true; }
+    check(threw, "a maze without a free cell is rejected");
+}
+
+// ----------------- Main -----------------
+
+int main(int argc, char** argv) {
+    const std::vector<std::pair<std::string, std::function<void()>>> tests = {
+        { "kernels", test_kernels },
+        { "gemm_shapes", test_gemm_shapes },
+        { "sparse_predict", test_sparse_predict },
+        { "threaded_fit", test_threaded_fit },
+        { "checkpoint", test_checkpoint },
+        { "get_data", test_get_data },
+        { "target_cache", test_target_cache },
+        { "replay_wraparound", test_replay_wraparound },
+        { "sum_tree", test_sum_tree },
+        { "prioritized", test_prioritized },
+        { "delta_save", test_delta_save },
+        { "state_codec", test_state_codec },
+        { "mapped_replay_store", test_mapped_replay_store },
+        { "maze_step", test_maze_step },
+        { "vector_maze", test_vector_maze },
+        { "valid_actions", test_valid_actions },
+        { "maze_generator", test_maze_generator },
+    };
+
+    std::string only = argc > 1 ? argv[1] : "";
+    int run = 0;
+    for (const auto& [name, test] : tests) {
+        if (!only.empty() && name != only) continue;
+        int before = failures;
+        try {
+            test();
+        }
+        catch (const std::exception& e) {
+            check(false, std::string("threw ") + e.what());
+        }
+        std::printf("%-24s %s\n", name.c_str(), failures == before ? "ok" : "FAILED");
+        ++run;
+    }
+    if (run == 0) {
+        std::printf("No test named %s\n", only.c_str());
+        return 1;
+    }
+    return failures == 0 ? 0 : 1;
+}